@@ -1,36 +1,341 @@
 // Non-standard libraries (raylib)
+#ifndef HEADLESS
 #include <raylib.h>
 #include <raymath.h>
+#include <rlgl.h>
+#endif
 
 // Standard libraries
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// The sprite archive built by `block_cycle --pack` (package.sh embeds it with -DEMBED_ASSETS)
+#ifdef EMBED_ASSETS
+#include "sprites_pak.h"
+#endif
+
+// The headless build has no raylib, so the parts of it the simulation needs live here
+#ifdef HEADLESS
+#include <stdbool.h>
+#include <float.h>
+
+#define PI 3.14159265358979323846f
+#define DEG2RAD (PI / 180.0f)
+
+typedef struct Vector2 {
+    float x;
+    float y;
+} Vector2;
+
+typedef struct Vector3 {
+    float x;
+    float y;
+    float z;
+} Vector3;
+
+typedef struct Rectangle {
+    float x;
+    float y;
+    float width;
+    float height;
+} Rectangle;
+
+typedef struct Color {
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+    unsigned char a;
+} Color;
+
+// Textures are never uploaded without a window, but keep the layout the same
+typedef struct Texture2D {
+    unsigned int id;
+    int width;
+    int height;
+    int mipmaps;
+    int format;
+} Texture2D;
+
+// Clamps a value between min and max
+float Clamp(float value, float min, float max) {
+    float result = value < min ? min : value;
+    return result > max ? max : result;
+}
+
+// Checks if two rectangles overlap (same as raylib)
+bool CheckCollisionRecs(Rectangle a, Rectangle b) {
+    return a.x < b.x + b.width && a.x + a.width > b.x &&
+           a.y < b.y + b.height && a.y + a.height > b.y;
+}
+
+// Checks if two line segments intersect (same as raylib)
+bool CheckCollisionLines(Vector2 startPos1, Vector2 endPos1, Vector2 startPos2, Vector2 endPos2, Vector2 * collisionPoint) {
+    float div = (endPos2.y - startPos2.y) * (endPos1.x - startPos1.x) - (endPos2.x - startPos2.x) * (endPos1.y - startPos1.y);
+
+    // Parallel lines never intersect
+    if(fabsf(div) < FLT_EPSILON)
+        return false;
+
+    float xi = ((startPos2.x - endPos2.x) * (startPos1.x * endPos1.y - startPos1.y * endPos1.x) - (startPos1.x - endPos1.x) * (startPos2.x * endPos2.y - startPos2.y * endPos2.x)) / div;
+    float yi = ((startPos2.y - endPos2.y) * (startPos1.x * endPos1.y - startPos1.y * endPos1.x) - (startPos1.y - endPos1.y) * (startPos2.x * endPos2.y - startPos2.y * endPos2.x)) / div;
+
+    // Make sure the intersection is within both segments
+    if(((fabsf(startPos1.x - endPos1.x) > FLT_EPSILON) && (xi < fminf(startPos1.x, endPos1.x) || xi > fmaxf(startPos1.x, endPos1.x))) ||
+       ((fabsf(startPos2.x - endPos2.x) > FLT_EPSILON) && (xi < fminf(startPos2.x, endPos2.x) || xi > fmaxf(startPos2.x, endPos2.x))) ||
+       ((fabsf(startPos1.y - endPos1.y) > FLT_EPSILON) && (yi < fminf(startPos1.y, endPos1.y) || yi > fmaxf(startPos1.y, endPos1.y))) ||
+       ((fabsf(startPos2.y - endPos2.y) > FLT_EPSILON) && (yi < fminf(startPos2.y, endPos2.y) || yi > fmaxf(startPos2.y, endPos2.y))))
+        return false;
+
+    if(collisionPoint) {
+        collisionPoint->x = xi;
+        collisionPoint->y = yi;
+    }
+    return true;
+}
+#endif
+
+// SIMD helpers, enemies are processed SIMD_WIDTH at a time (build with -DNO_SIMD for the scalar version)
+#if defined(__AVX__) && !defined(NO_SIMD)
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+typedef __m256 Floats;
+static inline Floats FloatsLoad(const float * p) { return _mm256_loadu_ps(p); }
+static inline void FloatsStore(float * p, Floats a) { _mm256_storeu_ps(p, a); }
+static inline Floats FloatsSet(float a) { return _mm256_set1_ps(a); }
+static inline Floats FloatsAdd(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+static inline Floats FloatsSub(Floats a, Floats b) { return _mm256_sub_ps(a, b); }
+static inline Floats FloatsMul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+static inline Floats FloatsMax(Floats a, Floats b) { return _mm256_max_ps(a, b); }
+static inline Floats FloatsAnd(Floats a, Floats b) { return _mm256_and_ps(a, b); }
+static inline Floats FloatsOr(Floats a, Floats b) { return _mm256_or_ps(a, b); }
+static inline Floats FloatsAbs(Floats a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline Floats FloatsLess(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline Floats FloatsLessEqual(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline int FloatsMask(Floats a) { return _mm256_movemask_ps(a); }
+#elif defined(__SSE2__) && !defined(NO_SIMD)
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+typedef __m128 Floats;
+static inline Floats FloatsLoad(const float * p) { return _mm_loadu_ps(p); }
+static inline void FloatsStore(float * p, Floats a) { _mm_storeu_ps(p, a); }
+static inline Floats FloatsSet(float a) { return _mm_set1_ps(a); }
+static inline Floats FloatsAdd(Floats a, Floats b) { return _mm_add_ps(a, b); }
+static inline Floats FloatsSub(Floats a, Floats b) { return _mm_sub_ps(a, b); }
+static inline Floats FloatsMul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+static inline Floats FloatsMax(Floats a, Floats b) { return _mm_max_ps(a, b); }
+static inline Floats FloatsAnd(Floats a, Floats b) { return _mm_and_ps(a, b); }
+static inline Floats FloatsOr(Floats a, Floats b) { return _mm_or_ps(a, b); }
+static inline Floats FloatsAbs(Floats a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline Floats FloatsLess(Floats a, Floats b) { return _mm_cmplt_ps(a, b); }
+static inline Floats FloatsLessEqual(Floats a, Floats b) { return _mm_cmple_ps(a, b); }
+static inline int FloatsMask(Floats a) { return _mm_movemask_ps(a); }
+#else
+#define SIMD_WIDTH 1
+#endif
 
 
 // Enemy constants
-#define ENEMY_TYPES 5           // How many types of enemies there are
-#define MAX_ENEMIES 255         // Max amount of enemies allowed on screen
+#define ENEMY_TYPES 5           // How many types of enemies there are (see enemyTypes)
+#define MAX_ENEMIES 255         // Default max amount of enemies allowed on screen
+#define ENEMY_CHUNK 1024        // How many enemy slots are reserved at a time
+#define ENEMY_BYTES (9 * sizeof(float) + sizeof(int) + 3 * sizeof(char)) // Memory used by a single enemy (see EnemyStore)
+#define HIT_PLAYER 1            // Collision flag for enemies that hit the player
+#define HIT_SHIELD 2            // Collision flag for enemies that hit the shield
+#define HIT_FRAGMENT 4          // Collision flag for enemies that ran into a small slime (or small slimes that ran into an enemy)
+
+// Enemy event types, enemies queue these during their update and they are applied afterwards in enemy order
+#define EVENT_HIT_PLAYER 0      // The enemy hit the player
+#define EVENT_KILL 1            // The enemy was killed (value is 1 for a close call by the shield, 2 if only a small slime hit it)
+#define EVENT_TIMER 2           // The enemy started a timed state (value is the TIMER_* transition to schedule)
+#define EVENT_RECLAIM 3         // The enemy can't be killed anymore (it's removed without scoring)
+
+// Timed enemy transitions, enemies schedule these on the timer wheel instead of counting down every tick (see FireTimer)
+#define TIMER_NONE 0            // Does nothing (for the timer benchmark)
+#define TIMER_REMOVE 1          // A dieing enemy finished fading out
+#define TIMER_SPLIT 2           // A dieing slime splits into small slimes
+#define TIMER_TURN 3            // A spinning enemy turns back towards the player
+#define TIMER_HOME 4            // A small slime starts homing in on the player
+#define TIMER_EXIT 5            // An orbiting enemy flies back out
+#define FADE_TIME 0.5f          // How long a dieing enemy fades out (seconds)
+
+// Timer wheel constants, level 0 slots are single ticks and every level above is 64 times coarser
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3          // Covers timers up to 64^3 ticks (about 36 minutes), later timers wait in the last level
+
+// Spatial grid constants (see BuildGrid)
+#define GRID_CELL_SIZE 2.0f     // Width of a grid cell (world units), about a slime so a search covers little more than its reach
+#define GRID_MIN_CELLS 1024     // The fewest cells the grid hashes into (a power of two)
+#define GRID_NEIGHBOURS 8       // Most neighbours an enemy interacts with in a tick (bounds the cost of a pile up)
+#define GRID_MAX_CELLS 64       // Most cells a query searches one by one, bigger areas check every entry instead
+#define GRID_PUSHES 1           // A slime that pushes other slimes away
+#define GRID_FRAGMENT 2         // A small slime that hits other enemies
+#define GRID_HITTABLE 4         // An enemy that small slimes can hit
+#define GRID_BUCKETS 3          // Buckets in every cell: small slimes, other slimes that push, then everything else
+
+// Enemy behaviours, every behaviour gets its own update loop (see ENEMY_KERNEL)
+#define BEHAVIOUR_PLAIN 0       // Flies straight at the player
+#define BEHAVIOUR_REFLECT 1     // Bounces off the shield, spins for a while and comes back (dies on the second hit)
+#define BEHAVIOUR_SPLIT 2       // Splits into small slimes that fly out and home back in (small slimes are state 2)
+#define BEHAVIOUR_ORBIT 3       // Circles the player for a while once close, then flies back out
+#define BEHAVIOUR_COUNT 4
+
+// Spawn edges, a wave spawns on any of the edges in its mask
+#define EDGE_LEFT 1
+#define EDGE_RIGHT 2
+#define EDGE_TOP 4
+#define EDGE_BOTTOM 8
+#define EDGE_ALL 15
+
+// Threading constants
+#define MAX_THREADS 16          // Max amount of threads updating enemies
+#define PARALLEL_ENEMIES 4096   // Enemies needed before the update is split across threads
 
 // Shield constants
 #define MAX_COLLISION_LINES 4   // The max amount of collision lines a shield can have
 #define SHIELD_COUNT 4          // The amount of shield types
 
+// Simulation constants
+#define TICK_RATE 120           // How many simulation ticks run per second
+#define TICK_TIME (1.0f / TICK_RATE) // The length of a single tick (seconds)
+#define MAX_FRAME_TIME 0.25f    // Longest frame that will be simulated (avoids a spiral of death)
+#define IDLE_WAKE_TIME 0.25     // How long frames keep drawing at full rate after an input (so its result gets drawn)
+#define IDLE_POLL_TIME 0.05     // How often an idle simulation thread checks for inputs (seconds)
+#define INPUT_CAPACITY 256      // How many inputs can wait for the simulation thread (a power of two)
+#define SNAPSHOT_FRESH 4        // Set on the middle snapshot when the simulation thread has finished a newer one
+#define LATENCY_SAMPLES 4096    // How many input latencies are kept
+#define PLAYER_SIZE 1           // Half of the player's width (world units), the player sits at the origin
+#define RECLAIM_DISTANCE 1.3f   // How far out (in halves of the window) an enemy has to be before it can be reclaimed
+
 // Other constants
 #define DEBUG 0                 // Debug mode will show all bounding boxes
 #define SHOP_ITEM_COUNT 4       // How many items in the shop
+#define MAX_SPRITES 32          // Max amount of images packed into the sprite atlas
+#define ATLAS_WIDTH 512         // Width of the sprite atlas (it grows downwards to fit)
+#define ARCHIVE_PATH "resources/sprites.pak"    // Where the packed sprite archive is kept
+#define ARCHIVE_VERSION 1       // Bumped whenever the archive layout changes
+#define REPLAY_VERSION 2        // Bumped whenever the replay layout changes
 
+// Replay inputs (everything from outside of the simulation that changes it)
+#define REPLAY_ROTATE 1         // The shield is aimed (value is the rotation in degrees)
+#define REPLAY_SHOP 2           // The shop is opened or closed
+#define REPLAY_BUY 3            // A shop item is bought (value is the item's index)
+#define REPLAY_RESET 4          // A new game is started after dying
+#define REPLAY_RESIZE 5         // The window is resized (value and value2 are the new size)
+#define REPLAY_END 6            // The recording is over (value is the game's hash)
+#define REPLAY_CHECK 7          // The game's hash after a tick, to find where a playback drifts (value is the hash)
 
-// The enemy structure
-typedef struct Enemy {
-    // ID 0 means dead
-    char id;
-    Vector2 position;
-    float rotation;
-    float speed;
-    Rectangle bounds;
-    float timer;
-    int state;
-} Enemy;
+// Replay flags, saved with a recording so a playback can tell if it runs the same math
+#define REPLAY_DETERMINISTIC 1  // Recorded with -DDETERMINISTIC
+
+// Profiler phases (timed every frame for the main world)
+#define PHASE_INPUT 0           // Handling input
+#define PHASE_SPAWN 1           // Spawn scheduling
+#define PHASE_ENEMIES 2         // Moving and updating enemies
+#define PHASE_COLLISION 3       // Shield geometry and collision
+#define PHASE_ENEMY_DRAW 4      // Drawing enemies
+#define PHASE_HUD_DRAW 5        // Drawing the player, shield and HUD
+#define PHASE_SHOP_DRAW 6       // Drawing the shop
+#define PHASE_PRESENT 7         // Ending the frame (GPU submit and vsync)
+#define PHASE_COUNT 8
+#define PROFILE_FRAMES 240      // How many frames of timings are kept
+#define TRACE_CAPACITY 65536    // How many trace events can wait to be written per thread (a power of two)
+#define TRACE_THREADS 2         // How many threads can trace, each has its own ring buffer (main, simulation)
+
+// Simulation math constants (see SimSinCos)
+#define SINE_TABLE_SIZE 4096    // Sine table entries over a whole turn (a power of two)
+#define ATAN_TABLE_SIZE 1024    // Arctangent table entries from 0 to 1
+
+// Cached HUD texts
+#define HUD_SCORE 0             // The score in the top left
+#define HUD_COINS 1             // The coin count in the top right
+#define HUD_BONUS 2             // The latest bonus under the coins
+#define HUD_HEARTS 3            // The hearts that don't fit on screen
+#define HUD_DIED 4              // The death banner
+#define HUD_CONTINUE 5          // The text under the death banner
+#define HUD_SHOP 6              // The shop title
+#define HUD_TEXT_COUNT 7
+#define HUD_TEXT_LENGTH 48      // Longest HUD text (in characters)
+
+
+// Enemy storage, every field has its own array so the hot loops only touch what they need
+// Living enemies are packed at the start of every array
+typedef struct EnemyStore {
+    float * x;              // Position
+    float * y;
+    float * lastX;          // Position at the previous tick (for interpolation)
+    float * lastY;
+    float * directionX;     // Cached sin(rotation)
+    float * directionY;     // Cached cos(rotation)
+    float * rotation;
+    float * speed;
+    float * size;           // Half of the enemy's width (world units)
+    int * timer;            // The enemy's scheduled transition (index into the world's timers, -1 if there is none)
+    char * id;
+    char * state;
+    unsigned char * hits;   // What the enemy hit this tick (HIT_PLAYER, HIT_SHIELD and HIT_FRAGMENT)
+    void * memory;          // The block of memory all of the arrays live in
+} EnemyStore;
+
+// An enemy side effect that has to wait until every enemy has been updated
+typedef struct EnemyEvent {
+    int type;
+    int index;
+    int value;
+} EnemyEvent;
+
+// A scheduled enemy transition, every wheel slot keeps a list of them
+typedef struct Timer {
+    int enemy;              // Index of the enemy (kept up to date as enemies move), -1 once cancelled
+    int kind;               // What happens (TIMER_*)
+    uint32_t due;           // The wheel tick it fires on
+    int next;               // The next timer in the same slot (or the next free timer)
+} Timer;
+
+// An enemy in the spatial grid, with copies of what queries need so a cell's entries sit next to each other in memory
+typedef struct GridEntry {
+    float x;                // The enemy's position when the grid was built (enemies move while it's queried)
+    float y;
+    float size;             // Half of the enemy's width
+    int enemy;              // The enemy's index
+    unsigned char flags;    // What the enemy does to its neighbours (GRID_*)
+} GridEntry;
+
+// A uniform spatial hash grid of the enemies, rebuilt every tick by BuildGrid
+// Cells are hashed so the grid covers any area, the entries of each cell are stored next to each other (a counting sort)
+// Every cell is split into buckets (see GRID_BUCKETS), so looking for slimes skips the crowds of other enemies
+typedef struct SpatialGrid {
+    int * bucketStarts;     // Where each bucket's entries start (cellCount * GRID_BUCKETS + 1 of them)
+    int cellCount;          // How many cells positions are hashed into (a power of two)
+    int * buckets;          // Each enemy's bucket (only used while building)
+    GridEntry * entries;    // The enemies that affect each other, sorted by bucket
+    int * order;            // The entries sorted by the chunk their enemy is updated in, in grid order within a chunk
+    int chunkStarts[MAX_THREADS + 1];   // Where each chunk's entries start in order
+    int count;              // How many entries there are (0 if the grid wasn't built this tick)
+    int capacity;           // How many entries fit in the arrays
+    float maxSize;          // Half of the widest entry's width (searches reach that far past their area)
+    int pushers;            // How many entries push (GRID_PUSHES)
+    int fragments;          // How many entries are small slimes (GRID_FRAGMENT)
+} SpatialGrid;
+
+// A list of enemy events (one per chunk of enemies)
+typedef struct EventBuffer {
+    EnemyEvent * events;
+    int count;
+    int capacity;
+} EventBuffer;
 
 // Basic line structure
 typedef struct Line {
@@ -40,10 +345,37 @@ typedef struct Line {
 
 // The shield structure
 typedef struct Shield {
-    Texture2D texture;
+    int sprite;
     Line lines[MAX_COLLISION_LINES];
 } Shield;
 
+// Everything that sets an enemy type apart, adding a type is a new entry in enemyTypes
+typedef struct EnemyType {
+    Vector3 color;
+    float speed;            // World units per second
+    float size;             // Half of the enemy's width (world units)
+    float smallSize;        // Half of the enemy's width in state 2 and later
+    int behaviour;          // How it acts (BEHAVIOUR_*)
+    float turnSpeed;        // How fast it spins (reflect) or circles (orbit) in radians per second
+    float turnTime;         // How long it spins before coming back (reflect)
+    float orbitRadius;      // How close it gets before circling (orbit)
+    float exitSpeed;        // Its speed after circling (orbit)
+    int splitCount;         // How many small slimes it splits into (split)
+    float pushSpeed;        // How fast it's pushed out of other slimes (world units per second, 0 doesn't push)
+} EnemyType;
+
+// A group of enemies spawned in the same tick, every level spawns its own wave (see defaultWaves)
+typedef struct Wave {
+    int count;                      // How many enemies spawn at once
+    int mix[ENEMY_TYPES + 1];       // How likely each enemy id is (weights, mix[0] is unused)
+    int edges;                      // Which edges they can spawn on (EDGE_*)
+
+    // Worked out by PrepareWave so spawning doesn't have to
+    int mixEnds[ENEMY_TYPES + 1];   // Running total of the weights up to each id
+    int edgeList[4];                // The allowed edges
+    int edgeCount;                  // How many edges are allowed
+} Wave;
+
 // Player bonus structure
 typedef struct Bonus {
     const char * name;
@@ -52,8 +384,8 @@ typedef struct Bonus {
 
 // Shop items structure
 typedef struct ShopItem {
-    // Texture of item inside the shop
-    Texture2D texture;
+    // Sprite of item inside the shop
+    int sprite;
     // How many coins for item
     int cost;
     // Type can be 0 (shield) or 1 (heart)
@@ -62,63 +394,198 @@ typedef struct ShopItem {
     int id;
 } ShopItem;
 
+// The start of a sprite archive, followed by an entry per sprite then the atlas pixels (RGBA)
+typedef struct ArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t count;
+} ArchiveHeader;
+
+// Where a sprite is inside of the archived atlas
+typedef struct ArchiveEntry {
+    char path[64];
+    float x;
+    float y;
+    float width;
+    float height;
+} ArchiveEntry;
+
+// A timed scope or instant for the trace file
+typedef struct TraceEvent {
+    const char * name;  // Must stay valid until written (string literals)
+    char type;          // 'X' for a scope, 'i' for an instant
+    double start;       // When it started (seconds)
+    float duration;     // How long it lasted (seconds)
+    int value;          // Shown as an argument in the trace viewer
+} TraceEvent;
+
+// A HUD text with its glyphs already laid out, it is only laid out again when its value or size changes
+typedef struct HudText {
+    bool built;                             // If the text has been laid out yet
+    int value;                              // The value the text was built from
+    int fontSize;                           // The size the text was built at
+    char text[HUD_TEXT_LENGTH];
+    int glyphCount;                         // How many glyphs have a quad (spaces don't)
+    Rectangle uvs[HUD_TEXT_LENGTH];         // Where each glyph is in the font texture (0 to 1)
+    Rectangle quads[HUD_TEXT_LENGTH];       // Where each glyph is drawn (relative to the text's position)
+    float width;                            // The width of the text (same as MeasureText)
+} HudText;
+
+// An input that is applied before a tick
+typedef struct ReplayEvent {
+    uint32_t tick;
+    int type;
+    int value;
+    int value2;
+} ReplayEvent;
+
+
+// Everything one game needs, so many games can be simulated at once
+typedef struct World {
+    // Shield variables
+    Shield currentShield;               // The currently selected shield
+
+    // Shield collision variables (rebuilt every tick by UpdateShieldGeometry)
+    Line shieldLines[MAX_COLLISION_LINES];      // The current shield's collision lines in window space
+    Vector2 shieldMins[MAX_COLLISION_LINES];    // The top left of each line's bounding box
+    Vector2 shieldMaxs[MAX_COLLISION_LINES];    // The bottom right of each line's bounding box
+    Vector2 shieldNormals[MAX_COLLISION_LINES]; // Each line's normal (as long as the line)
+    float shieldDistances[MAX_COLLISION_LINES]; // Each line's distance from 0,0 along its normal
+    float shieldSpans[MAX_COLLISION_LINES];     // How far along the normal a box of size 1 reaches
+    int shieldLineCount;                        // How many collision lines the current shield uses
+    float shieldInner;                          // The closest any collision line gets to the center
+    float shieldOuter;                          // The furthest any collision line gets from the center
+
+    // Enemy variables
+    EnemyStore enemies;                 // All present enemies
+    int enemyCount;                     // How many enemies are alive
+    int typeEnds[ENEMY_TYPES + 1];      // Where each type's enemies end (enemies are kept sorted by id), typeEnds[0] is always 0
+    int enemyCapacity;                  // How many enemies fit in the reserved memory
+    int enemyLimit;                     // Max amount of enemies allowed (can be raised for stress testing)
+    int droppedSpawns;                  // How many spawns failed because there was no room
+    int reclaimedEnemies;               // How many enemies were removed because they couldn't be killed anymore
+
+    // Timer wheel variables
+    Timer * timers;                     // Every timer, scheduled or free
+    int timerCapacity;                  // How many timers fit in the timers array
+    int timerUsed;                      // How many timers have ever been handed out (the rest of the array is untouched)
+    int freeTimer;                      // The first free timer (-1 if there is none)
+    int pendingTimers;                  // How many timers are scheduled and not cancelled
+    int wheel[WHEEL_LEVELS][WHEEL_SLOTS];   // The first timer in every slot (-1 if empty)
+    uint32_t wheelTick;                 // The last tick the wheel fired (only counts while enemies update)
+    EventBuffer eventBuffers[MAX_THREADS];  // The events queued by each chunk
+    SpatialGrid grid;                   // Where every enemy was at the start of the tick (for enemies that affect each other)
+
+    // Window variables (the simulation runs in world units centered on the player, only spawning needs the window's shape)
+    Vector2 windowSize;         // Window size
+    Vector2 center;             // Center of the window
+    Vector2 arena;              // Half of the window's size (world units)
+
+    // Player variables
+    bool died;                  // If the player has died
+    float deathTimer;           // How long since player died (for animations)
+    float rotation;             // Player rotation (degrees)
+    int hearts;                 // How many hearts the player has
+
+    // Scoring + money variables
+    int coins;                  // How many coins the player has
+    int score;                  // The players current score
+    Bonus latestBonus;          // The latest bonus gained by the player
+    double bonusTime;           // How long to display the bonus
+    double killTimer;           // How long between kills (for kill based rewards)
+    int bonusId;                // The id of the latest bonus
+    int enemyLevel;             // The max enemy level
+    int levelScores[ENEMY_TYPES];   // Each level's starting score
+
+    // Shop variables
+    bool shopOpen;              // If the player is in the shop
+
+    // Simulation variables
+    int spawnTicks;             // Ticks simulated while alive and unpaused since the last wave
+    float spawnTime;            // How many seconds between waves
+    float spawnStart;           // Seconds between spawns at a score of 0
+    float spawnRamp;            // Score it takes to spawn a second faster
+    float spawnMin;             // The fastest enemies can spawn
+    Wave waves[ENEMY_TYPES];    // The wave each enemy level spawns
+    uint32_t gameTick;          // How many ticks have been simulated
+    unsigned int randomState;   // Random number generator state (xorshift32)
+} World;
+
+// An input sampled by the render thread, waiting for the simulation thread to apply it
+typedef struct InputMessage {
+    ReplayEvent event;
+    double time;                // When it was sampled
+} InputMessage;
+
+// A finished tick handed from the simulation thread to the render thread, it isn't changed once handed over
+typedef struct Snapshot {
+    World world;                // Copy of the world, its enemies and timers are the snapshot's own copies
+    double time;                // When the tick finished (for interpolation)
+    bool replaying;             // If a replay was still playing
+    double profileTotals[PHASE_COUNT];  // Time the simulation thread has spent in each phase so far (ms)
+} Snapshot;
 
 // Shield variables
-Shield currentShield;               // The currently selected shield
 Shield shields[SHIELD_COUNT];       // All of theshield types
 
+// World variables (each thread simulates its own world, workers borrow the one being updated)
+World mainWorld;                    // The game that is being played
+__thread World * world = &mainWorld;    // The world this thread is simulating
+
 // Enemy variables
-Enemy enemies[MAX_ENEMIES];         // All present enemies
-Texture2D enemyTex;                 // The enemy texture
-Vector3 enemyColors[ENEMY_TYPES]={  // The enemy colors
-    (Vector3){
-        0,
-        0,
-        255
-    },
-    (Vector3){
-        0,
-        255,
-        0
-    },
-    (Vector3){
-        0,
-        255,
-        255
-    },
-    (Vector3){
-        255,
-        0,
-        255
-    },
-    (Vector3){
-        255, 
-        128, 
-        191
-    }
+int enemySprite;                    // The enemy sprite
+EnemyType enemyTypes[ENEMY_TYPES + 1] = {    // Every enemy type by id (ids start at 1)
+    // Color, speed, size, small size, behaviour, turn speed, turn time, orbit radius, exit speed, split count, push speed
+    {{0, 0, 0}, 0, 0, 0, BEHAVIOUR_PLAIN, 0, 0, 0, 0, 0, 0},
+    {{0, 0, 255}, 8, 1, 1, BEHAVIOUR_PLAIN, 0, 0, 0, 0, 0, 0},              // Blue block
+    {{0, 255, 0}, 16, 1, 1, BEHAVIOUR_PLAIN, 0, 0, 0, 0, 0, 0},             // Green block
+    {{0, 255, 255}, 7, 1, 1, BEHAVIOUR_REFLECT, PI / 2, 2, 0, 0, 0, 0},     // Cyan block
+    {{255, 0, 255}, 8, 1, 0.5f, BEHAVIOUR_SPLIT, 0, 0, 0, 0, 3, 4},         // Purple slime
+    {{255, 128, 191}, 16, 0.5f, 0.5f, BEHAVIOUR_ORBIT, 2, 0, 6, 8, 0, 4}    // Pink slime
 };
+Color enemyPalette[ENEMY_TYPES];    // The enemy colors ready for drawing
 
-// Window variables
-Vector2 windowSize;         // Window size
-Vector2 center;             // Center of the window
+// Worker variables, the main thread updates chunk 0 and worker n updates chunk n
+pthread_t workers[MAX_THREADS];                 // The worker threads
+int threadCount = 1;                            // How many threads update enemies (including the main thread)
+pthread_mutex_t workLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t workReady = PTHREAD_COND_INITIALIZER;    // Signalled when there is new work
+pthread_cond_t workDone = PTHREAD_COND_INITIALIZER;     // Signalled when the last worker finishes
+int workGeneration = 0;                         // Increased every time there is new work
+int workPending = 0;                            // How many workers are still busy
+bool workStopping = false;                      // Tells the workers to exit
+int workChunks = 1;                             // How many chunks the enemies are split into this tick
+float workDeltaTime = 0;                        // The tick being simulated
+World * workWorld = &mainWorld;                 // The world the workers are updating
 
 // Player variables
-Rectangle playerRect;       // The players bounding rectangle
-bool died = false;          // If the player has died
-float deathTimer = 0;       // How long since player died (for animations)
-float rotation = 0;         // Player rotation (degrees)
-Texture2D playerTex[4];     // All of the players textures
-int sprite = 0;             // The index of the players current texture
-int hearts = 1;             // How many hearts the player has
-
-// Other textures
-Texture2D coin;
-Texture2D arrow;
-Texture2D heart;
-
-// Scoring + money variables
-int coins = 0;         // How many coins the player has
-int score = 0;         // The players current score
+int playerSprites[4];       // All of the players sprites
+int sprite = 0;             // The index of the players current sprite
+
+// Other sprites
+int coinSprite;
+int arrowSprite;
+int heartSprite;
+
+// Sprite atlas variables
+const char * spritePaths[MAX_SPRITES];  // The image each sprite is loaded from
+Rectangle sprites[MAX_SPRITES];         // Where each sprite is in the atlas
+int spriteCount = 0;                    // How many sprites have been loaded
+Texture2D atlas;                        // The texture every sprite is packed into
+int spriteDrawCalls = 0;                // How many sprite draw calls were made this frame
+int spriteVertices = 0;                 // How many sprite vertices were drawn this frame
+
+// HUD text variables
+HudText hudTexts[HUD_TEXT_COUNT];       // The laid out HUD texts
+int hudTextBuilds = 0;                  // How many HUD texts were laid out this frame
+
+// Low resolution variables
+int lowResHeight = 0;                   // The height the game is drawn at before it's scaled up (0 draws at the window's resolution)
+bool lowResHud = false;                 // If the HUD is drawn at the low resolution too instead of the window's
+
+// Scoring variables
 Bonus bonuses[] = {     // Moves that can grant the player coins
     {"Close call", 5},
     {"Double kill", 2},
@@ -126,35 +593,485 @@ Bonus bonuses[] = {     // Moves that can grant the player coins
     {"Multi kill", 10},
     {"Milestone", 5}
 };
-Bonus latestBonus;      // The latest bonus gained by the player
-double bonusTime = 2;   // How long to display the bonus
-double killTimer = 0;   // How long between kills (for kill based rewards)
-int bonusId;            // The id of the latest bonus
-int enemyLevel = 0;     // The max enemy level
-int levelScores[ENEMY_TYPES] = {    // Each level's starting score
+int defaultLevelScores[ENEMY_TYPES] = {    // Each level's starting score
     0, 5, 10, 40, 80
 };
+Wave defaultWaves[ENEMY_TYPES] = {  // Each level's wave, one enemy of any unlocked type from any edge (the rest is worked out by PrepareWave)
+    {1, {0, 1}, EDGE_ALL, {0}, {0}, 0},
+    {1, {0, 1, 1}, EDGE_ALL, {0}, {0}, 0},
+    {1, {0, 1, 1, 1}, EDGE_ALL, {0}, {0}, 0},
+    {1, {0, 1, 1, 1, 1}, EDGE_ALL, {0}, {0}, 0},
+    {1, {0, 1, 1, 1, 1, 1}, EDGE_ALL, {0}, {0}, 0}
+};
 
 // Shop variables
-bool shopOpen = false;          // If the player is in the shop
 double shopTimer = 0;           // Time since shop opened (For animations)
 ShopItem shopItems[SHOP_ITEM_COUNT];
 int shopPage = 0;               // The page the player is on
 
+// Profiler variables
+const char * phaseNames[PHASE_COUNT + 1] = {
+    "Input", "Spawn scheduling", "Enemy update", "Shield collision",
+    "Enemy draw", "HUD draw", "Shop draw", "Present", "Frame"
+};
+__thread double profileStarts[PHASE_COUNT];             // When each phase started
+__thread float profileTimes[PHASE_COUNT];               // Time spent in each phase this frame (ms, every thread has its own)
+__thread bool profiling = false;                        // If this thread's phases are timed (the main thread and simulation thread)
+float profileHistory[PROFILE_FRAMES][PHASE_COUNT + 1];  // Ring buffer of timings with the frame time last
+int profileFrame = 0;                                   // Where the next frame is stored
+int profileFrameCount = 0;                              // How many frames have been stored
+bool profileOverlay = false;                            // If the profiler is drawn (toggled with F3)
+
+// Trace variables (the main and simulation threads add events and a writer thread saves them)
+__thread bool tracing = false;              // If this thread adds events (the main thread and simulation thread)
+__thread int traceRing = 0;                 // Which ring buffer this thread adds to (shown as the trace's thread id)
+TraceEvent traceEvents[TRACE_THREADS][TRACE_CAPACITY];  // Ring buffers of events waiting to be written, one per thread
+unsigned int traceHead[TRACE_THREADS];      // Events added (only changed by the ring's thread)
+unsigned int traceTail[TRACE_THREADS];      // Events written (only changed by the writer thread)
+unsigned int traceDropped = 0;              // Events lost because the writer fell behind
+FILE * traceFile = NULL;                    // Where the trace is written
+double traceStart = 0;                      // When the trace started
+pthread_t traceThread;
+pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t traceWake = PTHREAD_COND_INITIALIZER;    // Wakes the writer early when stopping
+bool traceStopping = false;
+bool traceWait = false;                     // Wait for room instead of dropping events (headless replays)
+
+// Replay variables
+const int replayValues[] = {0, 1, 0, 1, 0, 2, 1, 1};   // How many values each replay event has
+FILE * recordFile = NULL;       // Where inputs are being recorded to
+FILE * replayFile = NULL;       // Where inputs are being played back from
+ReplayEvent replayEvent;        // The next input to play back
+uint32_t replayTick = 0;        // The tick of the last event read or written (events store the difference)
+bool recordChecks = false;      // If the hash of every tick is recorded (headless recordings, to cross-check builds)
+uint32_t replayDrift = 0;       // The first tick a playback's hash didn't match the recording (0 if none have)
+bool replaying = false;         // If the game is showing a replay, so the player's inputs are ignored (render thread)
+int sentRotation = -1;          // The last rotation the player sent to the simulation
+
+// Simulation thread variables (the render thread samples input and draws snapshots, the simulation thread runs the ticks)
+bool simThreaded = false;       // If the simulation runs on its own thread (--single-thread turns it off in the game)
+pthread_t simThread;
+bool simStopping = false;
+InputMessage inputQueue[INPUT_CAPACITY];    // Ring buffer of inputs waiting for the simulation thread
+unsigned int inputHead = 0;     // Inputs sent (only changed by the render thread)
+unsigned int inputTail = 0;     // Inputs applied (only changed by the simulation thread)
+Snapshot snapshots[3];          // Triple buffer, the simulation thread writes one while the render thread reads another
+int snapshotMiddle = 1;         // The snapshot between the threads, SNAPSHOT_FRESH is set when it's newer than the render thread's
+int snapshotBack = 2;           // The snapshot being written (only used by the simulation thread)
+int snapshotFront = 0;          // The snapshot being drawn (only used by the render thread)
+double simProfileTotals[PHASE_COUNT];   // Time the simulation thread has spent in each phase (ms)
+double drawnProfileTotals[PHASE_COUNT]; // The simulation times already added to the render thread's profile
+
+// Input latency variables (only changed by whichever thread simulates)
+float latencyHistory[LATENCY_SAMPLES];  // Ring buffer of times from sampling a rotation to the shield using it (ms)
+int latencyCount = 0;           // How many latencies have been measured
+double latencyPending = 0;      // When the oldest rotation the shield hasn't used yet was sampled (0 if none)
+
+// Idle variables (only used by the render thread)
+double awakeUntil = 0;          // Frames are drawn at full rate until then, even if nothing seems to move
+bool idleFrames = false;        // If the frame loop is waiting for input events instead of drawing at full rate
+
+// Seeds the random number generator
+void SeedRandom(unsigned int seed) {
+    // Xorshift gets stuck on a zero state
+    world->randomState = seed ? seed : 0x2545F491;
+}
+
+// Gets a random value between min and max (both included)
+int RandomValue(int min, int max) {
+    if(min > max) {
+        int temp = max;
+        max = min;
+        min = temp;
+    }
+
+    world->randomState ^= world->randomState << 13;
+    world->randomState ^= world->randomState >> 17;
+    world->randomState ^= world->randomState << 5;
+    return (int)(world->randomState % (unsigned int)(max - min + 1)) + min;
+}
+
+// Gets a monotonic time in seconds (for benchmarking, profiling and startup times)
+double Now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Simulation math
+// libm's sin, cos and atan2 are exact to the last bit, which the game doesn't need, and every libm rounds them its own way
+// The fast versions are polynomials and the table versions are lookups, both use + - * / only so every build gets the same bits
+// -DDETERMINISTIC makes the simulation use the tables, which are filled once with the same bits whatever the compiler does to the polynomials
+float sineTable[SINE_TABLE_SIZE + 1];   // sin over a whole turn (the last entry wraps around)
+float atanTable[ATAN_TABLE_SIZE + 1];   // atan from 0 to 1
+
+// Sine of x (radians, within a quarter turn) from its power series
+double SeriesSin(double x) {
+    double term = x;
+    double sum = x;
+    for(int i = 1; i < 12; ++i) {
+        term *= -x * x / ((2 * i) * (2 * i + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+// Arctangent of x (between 0 and 1) from its power series, after halving the angle twice so it converges quickly
+double SeriesAtan(double x) {
+    for(int i = 0; i < 2; ++i)
+        x = x / (1 + sqrt(1 + x * x));
+
+    double term = x;
+    double sum = x;
+    for(int i = 1; i < 16; ++i) {
+        term *= -x * x;
+        sum += term / (2 * i + 1);
+    }
+    return sum * 4;
+}
+
+// Fills the trig tables
+void InitTrig() {
+    // Only a quarter of the sine is calculated, the rest is mirrored so the table is exactly symmetric
+    int quarter = SINE_TABLE_SIZE / 4;
+    for(int i = 0; i <= quarter; ++i) {
+        float value = (float)SeriesSin(i * (3.14159265358979323846 / 2) / quarter);
+        sineTable[i] = value;
+        sineTable[quarter * 2 - i] = value;
+        sineTable[quarter * 2 + i] = -value;
+        sineTable[(quarter * 4 - i) % SINE_TABLE_SIZE] = -value;
+    }
+    sineTable[SINE_TABLE_SIZE] = sineTable[0];
+
+    for(int i = 0; i <= ATAN_TABLE_SIZE; ++i)
+        atanTable[i] = (float)SeriesAtan((double)i / ATAN_TABLE_SIZE);
+}
+
+// Looks up the sine table at a position in table entries
+static inline float SineLookup(float position) {
+    float index = floorf(position);
+    float fraction = position - index;
+    int i = (int)index & (SINE_TABLE_SIZE - 1);
+    return sineTable[i] + (sineTable[i + 1] - sineTable[i]) * fraction;
+}
+
+// sinf and cosf from the sine table (within 2e-6 for angles up to a few turns, bigger angles lose precision in the position)
+static inline void TableSinCos(float angle, float * sine, float * cosine) {
+    float position = angle * (SINE_TABLE_SIZE / (2 * PI));
+    *sine = SineLookup(position);
+    *cosine = SineLookup(position + SINE_TABLE_SIZE / 4);
+}
+
+// Mirrors an angle of the first eighth of a turn into the right place for atan2
+// Multiplying by ±1 and adding 0 are exact, so this is the same as flipping with ifs but doesn't branch on random signs
+static inline float MirrorAtan(float angle, float y, float x, bool steep) {
+    const float flips[2] = {1, -1};
+    const float quarters[2] = {0, PI / 2};
+    const float halves[2] = {0, PI};
+    angle = quarters[steep] + flips[steep] * angle;
+    angle = halves[x < 0] + flips[x < 0] * angle;
+    return flips[y < 0] * angle;
+}
+
+// Divides the smaller of two positive numbers by the larger (min and max instructions instead of a branch)
+static inline float OctantRatio(float ax, float ay) {
+    float low = ax < ay ? ax : ay;
+    float high = ax < ay ? ay : ax;
+    return low / high;
+}
+
+// atan2f from the arctangent table (within 4e-7)
+static inline float TableAtan2(float y, float x) {
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    if(ax == 0 && ay == 0)
+        return 0;
+
+    float ratio = OctantRatio(ax, ay) * ATAN_TABLE_SIZE;
+    int i = (int)ratio;
+    if(i >= ATAN_TABLE_SIZE)
+        i = ATAN_TABLE_SIZE - 1;
+    return MirrorAtan(atanTable[i] + (atanTable[i + 1] - atanTable[i]) * (ratio - i), y, x, ay > ax);
+}
+
+// sinf and cosf from one range reduction and two short polynomials (within 1e-7 for angles the game uses)
+static inline void FastSinCos(float angle, float * sine, float * cosine) {
+    // Take off the closest multiple of a quarter turn (in two parts so the subtraction stays exact)
+    // Adding and taking away 1.5 * 2²³ rounds to a whole number without calling floorf
+    float quarters = (angle * (float)(2 / 3.14159265358979323846) + 12582912.0f) - 12582912.0f;
+    float x = angle - quarters * 1.5703125f - quarters * 4.83826794896619e-4f;
+    float x2 = x * x;
+
+    // Power series up to x⁹ and x¹⁰, the rest is below float precision within an eighth of a turn
+    float s = x + x * x2 * (-1 / 6.0f + x2 * (1 / 120.0f + x2 * (-1 / 5040.0f + x2 * (1 / 362880.0f))));
+    float c = 1 + x2 * (-1 / 2.0f + x2 * (1 / 24.0f + x2 * (-1 / 720.0f + x2 * (1 / 40320.0f + x2 * (-1 / 3628800.0f)))));
+
+    // Swap and flip them depending on the quarter the angle was in (looked up instead of branched on, the quarter is random)
+    int quarter = (int)quarters;
+    float values[2] = {s, c};
+    *sine = values[quarter & 1] * (1 - (quarter & 2));
+    *cosine = values[~quarter & 1] * (1 - ((quarter + 1) & 2));
+}
+
+// atan2f from a polynomial (Abramowitz and Stegun 4.4.49, within 3e-7)
+static inline float FastAtan2(float y, float x) {
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    if(ax == 0 && ay == 0)
+        return 0;
+
+    float z = OctantRatio(ax, ay);
+    float z2 = z * z;
+    float angle = z * (0.9999993329f + z2 * (-0.3332985605f + z2 * (0.1994653599f + z2 * (-0.1390853351f +
+        z2 * (0.0964200441f + z2 * (-0.0559098861f + z2 * (0.0218612288f + z2 * -0.0040540580f)))))));
+    return MirrorAtan(angle, y, x, ay > ax);
+}
+
+// sinf and cosf of the same angle for the simulation
+static inline void SimSinCos(float angle, float * sine, float * cosine) {
+#ifdef DETERMINISTIC
+    TableSinCos(angle, sine, cosine);
+#else
+    FastSinCos(angle, sine, cosine);
+#endif
+}
+
+// atan2f for the simulation
+static inline float SimAtan2(float y, float x) {
+#ifdef DETERMINISTIC
+    return TableAtan2(y, x);
+#else
+    return FastAtan2(y, x);
+#endif
+}
+
+// Starts timing a phase of the frame (only the threads playing the main world are profiled)
+void ProfileBegin(int phase) {
+    if(profiling)
+        profileStarts[phase] = Now();
+}
+
+// Adds an event to the trace without waiting (it is dropped if the writer is too far behind)
+// Every tracing thread has its own ring buffer, so each one has a single producer
+void PushTrace(const char * name, char type, double start, double end, int value) {
+    if(traceFile == NULL || !tracing)
+        return;
+
+    unsigned int head = traceHead[traceRing];
+    while(head - __atomic_load_n(&traceTail[traceRing], __ATOMIC_ACQUIRE) >= TRACE_CAPACITY) {
+        if(!traceWait) {
+            __atomic_add_fetch(&traceDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        sched_yield();
+    }
+
+    traceEvents[traceRing][head % TRACE_CAPACITY] = (TraceEvent){name, type, start, (float)(end - start), value};
+    __atomic_store_n(&traceHead[traceRing], head + 1, __ATOMIC_RELEASE);
+}
+
+// Traces a scope that started at start and ends now
+void TraceScope(const char * name, double start, int value) {
+    if(traceFile != NULL)
+        PushTrace(name, 'X', start, Now(), value);
+}
+
+// Traces something that happened now
+void TraceInstant(const char * name, int value) {
+    if(traceFile != NULL) {
+        double now = Now();
+        PushTrace(name, 'i', now, now, value);
+    }
+}
+
+// Stops timing a phase, phases can be timed more than once a frame (once per tick)
+void ProfileEnd(int phase) {
+    if(!profiling)
+        return;
+
+    double now = Now();
+    profileTimes[phase] += (float)((now - profileStarts[phase]) * 1000);
+    if(traceFile != NULL)
+        PushTrace(phaseNames[phase], 'X', profileStarts[phase], now, 0);
+}
+
+// Stores this frame's timings in the ring buffer and starts the next frame
+void ProfileFrame(float frameTime) {
+    for(int i = 0; i < PHASE_COUNT; ++i) {
+        profileHistory[profileFrame][i] = profileTimes[i];
+        profileTimes[i] = 0;
+    }
+    profileHistory[profileFrame][PHASE_COUNT] = frameTime * 1000;
+
+    profileFrame = (profileFrame + 1) % PROFILE_FRAMES;
+    if(profileFrameCount < PROFILE_FRAMES)
+        ++profileFrameCount;
+}
+
+// Sorts floats from smallest to largest (for qsort)
+int CompareFloats(const void * a, const void * b) {
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Gets the p50, p95 and p99 of a phase over the stored frames (PHASE_COUNT is the whole frame)
+void ProfilePercentiles(int phase, float * percentiles) {
+    static float sorted[PROFILE_FRAMES];
+    if(profileFrameCount == 0) {
+        percentiles[0] = percentiles[1] = percentiles[2] = 0;
+        return;
+    }
+
+    for(int i = 0; i < profileFrameCount; ++i)
+        sorted[i] = profileHistory[i][phase];
+    qsort(sorted, profileFrameCount, sizeof(float), CompareFloats);
+
+    percentiles[0] = sorted[profileFrameCount * 50 / 100];
+    percentiles[1] = sorted[profileFrameCount * 95 / 100];
+    percentiles[2] = sorted[profileFrameCount * 99 / 100];
+}
+
+// Prints the stored timings of every phase
+void PrintProfile() {
+    printf("Profile of the last %d frames (ms):    p50      p95      p99\n", profileFrameCount);
+    for(int i = 0; i <= PHASE_COUNT; ++i) {
+        float percentiles[3];
+        ProfilePercentiles(i, percentiles);
+        printf("%-32s %8.3f %8.3f %8.3f\n", phaseNames[i], percentiles[0], percentiles[1], percentiles[2]);
+    }
+}
+
+// Trace writer thread entrypoint, saves events in the background so the game never waits on the disk
+void * TraceWriter(void * argument) {
+    pthread_mutex_lock(&traceLock);
+    while(true) {
+        bool stopping = traceStopping;
+        pthread_mutex_unlock(&traceLock);
+
+        // Write everything that is waiting in every thread's ring buffer
+        for(int ring = 0; ring < TRACE_THREADS; ++ring) {
+            unsigned int head = __atomic_load_n(&traceHead[ring], __ATOMIC_ACQUIRE);
+            for(unsigned int tail = traceTail[ring]; tail != head; ++tail) {
+                TraceEvent event = traceEvents[ring][tail % TRACE_CAPACITY];
+                fprintf(
+                    traceFile,
+                    ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,",
+                    event.name,
+                    event.type,
+                    (event.start - traceStart) * 1e6
+                );
+                if(event.type == 'X')
+                    fprintf(traceFile, "\"dur\":%.3f,", event.duration * 1e6);
+                else
+                    fprintf(traceFile, "\"s\":\"t\",");
+                fprintf(traceFile, "\"pid\":1,\"tid\":%d,\"args\":{\"value\":%d}}", ring + 1, event.value);
+
+                __atomic_store_n(&traceTail[ring], tail + 1, __ATOMIC_RELEASE);
+            }
+        }
+
+        pthread_mutex_lock(&traceLock);
+        if(stopping)
+            break;
+
+        // Sleep for a few milliseconds (or until stopped)
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += 5000000;
+        if(wake.tv_nsec >= 1000000000) {
+            wake.tv_nsec -= 1000000000;
+            ++wake.tv_sec;
+        }
+        if(!traceStopping)
+            pthread_cond_timedwait(&traceWake, &traceLock, &wake);
+    }
+    pthread_mutex_unlock(&traceLock);
+    return NULL;
+}
+
+// Starts writing a Chrome trace event file (opened with chrome://tracing or Perfetto)
+bool StartTrace(const char * fileName) {
+    traceFile = fopen(fileName, "w");
+    if(traceFile == NULL)
+        return false;
+
+    fprintf(traceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    // Name the thread of every ring buffer
+    const char * threadNames[TRACE_THREADS] = {"Main thread", "Simulation thread"};
+    for(int i = 0; i < TRACE_THREADS; ++i)
+        fprintf(traceFile, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i ? "," : "", i + 1, threadNames[i]);
+    traceStart = Now();
+    traceStopping = false;
+    if(pthread_create(&traceThread, NULL, TraceWriter, NULL) != 0) {
+        fclose(traceFile);
+        traceFile = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Writes the remaining events and closes the trace
+void StopTrace() {
+    if(traceFile == NULL)
+        return;
+
+    pthread_mutex_lock(&traceLock);
+    traceStopping = true;
+    pthread_cond_signal(&traceWake);
+    pthread_mutex_unlock(&traceLock);
+    pthread_join(traceThread, NULL);
+
+    fprintf(traceFile, "\n]}\n");
+    fclose(traceFile);
+    traceFile = NULL;
+    if(traceDropped > 0)
+        printf("%u trace events were dropped because the writer fell behind\n", traceDropped);
+}
 
 // GetBonus gives the player the specified bonus by id
 void GetBonus(int id) {
-    bonusId = id;
-    latestBonus = bonuses[id];
-    bonusTime = 0;
-    coins += latestBonus.reward;
+    world->bonusId = id;
+    world->latestBonus = bonuses[id];
+    world->bonusTime = 0;
+    world->coins += world->latestBonus.reward;
+}
+
+// LoadSprite adds an image to the sprite atlas, it returns the new sprite's index
+// The atlas is only built (and the image loaded) by BuildAtlas, so this works without a window
+int LoadSprite(const char * fileName) {
+    if(spriteCount >= MAX_SPRITES)
+        return 0;
+
+    spritePaths[spriteCount] = fileName;
+    return spriteCount++;
+}
+
+// BuyShopItem buys a shop item by index if the player can afford it
+bool BuyShopItem(int index) {
+    if(world->coins < shopItems[index].cost)
+        return false;
+
+    world->coins -= shopItems[index].cost;
+    switch(shopItems[index].type) {
+        case 0: // Shield
+            world->currentShield = shields[shopItems[index].id];
+            break;
+        case 1: // Heart
+            world->hearts += shopItems[index].id;
+            break;
+    }
+    return true;
 }
 
 // Rotates a point around the 0,0 point
 Vector2 RotatePoint(Vector2 point, float rotation) {
+    float sine, cosine;
+    SimSinCos(rotation, &sine, &cosine);
     return (Vector2){
-        cos(rotation) * point.x - sin(rotation) * point.y,
-        sin(rotation) * point.x + cos(rotation) * point.y
+        cosine * point.x - sine * point.y,
+        sine * point.x + cosine * point.y
     };
 }
 
@@ -218,784 +1135,4069 @@ bool LineRectCollision(Line a, Rectangle b) {
     return false;
 }
 
-// SpawnEnemy is used to create new enemies, it returns the new enemy's index
-int SpawnEnemy(int id, int state) {
-    // Find a free space for the enemy
-    int index;
-    for(index = 0; index<MAX_ENEMIES; ++index) {
-        // Break when a free space is found
-        if(enemies[index].id == 0)
-            break;
-    }
+// Takes an array out of a block of memory and copies the living enemies' values into it
+void * TakeEnemyArray(char ** memory, void * old, int capacity, int size) {
+    void * array = *memory;
+    *memory += capacity * size;
+    if(old)
+        memcpy(array, old, world->enemyCount * size);
+    return array;
+}
 
-    // Calculate position
-    Vector2 position = {
-        (float)GetRandomValue(0, windowSize.x),
-        (float)GetRandomValue(0, windowSize.y)
-    };
+// ReserveEnemies makes sure there is memory for at least the given amount of enemies
+// Memory is reserved in whole chunks so spawning rarely needs to allocate
+bool ReserveEnemies(int count) {
+    if(count <= world->enemyCapacity)
+        return true;
 
-    // Snap enemy to one of the 4 walls
-    if (GetRandomValue(0, 1)) {
-        // Horizontal wall
-        position.x = (GetRandomValue(0, 1) * 1.2 - 0.1) * windowSize.x; // Offset of 0.1 times the window
-    }
-    else {
-        // Vertical wall
-        position.y = (GetRandomValue(0, 1) * 1.2 - 0.1) * windowSize.y; // Offset of 0.1 times the window
-    }
-
-    // Set the enemy
-    enemies[index].id = id;
-    enemies[index].speed = 8;
-    enemies[index].position = position;
-    enemies[index].state = state;
-    enemies[index].timer = 0;
-    enemies[index].rotation = atan2(center.x - position.x, center.y - position.y);
-
-    // Apply enemy specific customization
-    switch(id) {
-        case 3:
-            enemies[index].speed = 7;
-            break;
-        case 2:
-        case 5:
-            enemies[index].speed = 16;
-            break;
-    }
-    return index;
+    // Round up to the next chunk
+    int capacity = (count + ENEMY_CHUNK - 1) / ENEMY_CHUNK * ENEMY_CHUNK;
+
+    // All of the arrays share one block of memory
+    char * memory = (char *)calloc(capacity, ENEMY_BYTES);
+    if(!memory)
+        return false;
+
+    EnemyStore store;
+    store.memory = memory;
+    store.x = (float *)TakeEnemyArray(&memory, world->enemies.x, capacity, sizeof(float));
+    store.y = (float *)TakeEnemyArray(&memory, world->enemies.y, capacity, sizeof(float));
+    store.lastX = (float *)TakeEnemyArray(&memory, world->enemies.lastX, capacity, sizeof(float));
+    store.lastY = (float *)TakeEnemyArray(&memory, world->enemies.lastY, capacity, sizeof(float));
+    store.directionX = (float *)TakeEnemyArray(&memory, world->enemies.directionX, capacity, sizeof(float));
+    store.directionY = (float *)TakeEnemyArray(&memory, world->enemies.directionY, capacity, sizeof(float));
+    store.rotation = (float *)TakeEnemyArray(&memory, world->enemies.rotation, capacity, sizeof(float));
+    store.speed = (float *)TakeEnemyArray(&memory, world->enemies.speed, capacity, sizeof(float));
+    store.size = (float *)TakeEnemyArray(&memory, world->enemies.size, capacity, sizeof(float));
+    store.timer = (int *)TakeEnemyArray(&memory, world->enemies.timer, capacity, sizeof(int));
+    store.id = (char *)TakeEnemyArray(&memory, world->enemies.id, capacity, sizeof(char));
+    store.state = (char *)TakeEnemyArray(&memory, world->enemies.state, capacity, sizeof(char));
+    store.hits = (unsigned char *)TakeEnemyArray(&memory, world->enemies.hits, capacity, sizeof(unsigned char));
+
+    free(world->enemies.memory);
+    world->enemies = store;
+    world->enemyCapacity = capacity;
+    return true;
 }
 
-// Spawns enemy without a provided state
-int SpawnDefaultEnemy(int id) {
-    return SpawnEnemy(id, 0);
+// Gets half of an enemy's width (in world units)
+float EnemySize(int id, int state) {
+    return state >= 2 ? enemyTypes[id].smallSize : enemyTypes[id].size;
 }
 
-// Changes the score and updates enemy level
-void SetScore(int newScore) {
-    // Set the score
-    score = newScore;
+// Changes an enemy's state, keeping its size up to date
+void SetEnemyState(int index, int state) {
+    world->enemies.state[index] = state;
+    world->enemies.size[index] = EnemySize(world->enemies.id[index], state);
+}
 
-    // Reset enemy level on score reset
-    if(score <= 0) {
-        enemyLevel = 0;
-        return;
+// Turns an enemy, keeping its cached direction up to date
+void SetEnemyRotation(int index, float rotation) {
+    world->enemies.rotation[index] = rotation;
+    SimSinCos(rotation, &world->enemies.directionX[index], &world->enemies.directionY[index]);
+}
+
+// Copies an enemy into another slot
+void MoveEnemy(int from, int to) {
+    world->enemies.x[to] = world->enemies.x[from];
+    world->enemies.y[to] = world->enemies.y[from];
+    world->enemies.lastX[to] = world->enemies.lastX[from];
+    world->enemies.lastY[to] = world->enemies.lastY[from];
+    world->enemies.directionX[to] = world->enemies.directionX[from];
+    world->enemies.directionY[to] = world->enemies.directionY[from];
+    world->enemies.rotation[to] = world->enemies.rotation[from];
+    world->enemies.speed[to] = world->enemies.speed[from];
+    world->enemies.size[to] = world->enemies.size[from];
+    world->enemies.timer[to] = world->enemies.timer[from];
+    if(world->enemies.timer[to] >= 0)
+        world->timers[world->enemies.timer[to]].enemy = to;
+    world->enemies.id[to] = world->enemies.id[from];
+    world->enemies.state[to] = world->enemies.state[from];
+    world->enemies.hits[to] = world->enemies.hits[from];
+}
+
+// SpawnEnemies makes room for a block of new enemies of one type, it returns the index of the first one
+// The new enemies are the last enemies of their type, spawns past the enemy limit are dropped so fewer can be made
+// Only the enemy's type and state are set, the caller places them (see PlaceEnemies)
+int SpawnEnemies(int id, int state, int count) {
+    // Drop whatever doesn't fit
+    int room = world->enemyLimit - world->enemyCount;
+    if(count > room) {
+        world->droppedSpawns += count - (room > 0 ? room : 0);
+        count = room;
+    }
+    if(count <= 0)
+        return -1;
+    if(!ReserveEnemies(world->enemyCount + count)) {
+        world->droppedSpawns += count;
+        return -1;
     }
 
-    // Update the enemy level
-    for(int i = 0; i < ENEMY_TYPES; ++i) {
-        if(levelScores[i] == score) {
-            enemyLevel = i;
+    // Keep the enemies sorted by id, every later type moves up by count
+    // Only the first enemies of a type have to move (to the end of the type), starting with the last type so nothing is overwritten
+    for(int type = ENEMY_TYPES; type > id; --type) {
+        int start = world->typeEnds[type - 1];
+        int end = world->typeEnds[type];
+        int moved = end - start < count ? end - start : count;
+        int target = end > start + count ? end : start + count;
+        for(int j = 0; j < moved; ++j)
+            MoveEnemy(start + j, target + j);
+    }
+    int first = world->typeEnds[id];
+    for(int type = id; type <= ENEMY_TYPES; ++type)
+        world->typeEnds[type] += count;
+    world->enemyCount += count;
 
-            // Get the "Milestone" bonus
-            GetBonus(4);
-        }
+    // Set everything that doesn't depend on where they are
+    for(int i = first; i < first + count; ++i) {
+        world->enemies.id[i] = id;
+        world->enemies.speed[i] = enemyTypes[id].speed;
+        world->enemies.timer[i] = -1;
+        world->enemies.hits[i] = 0;
+        world->enemies.state[i] = state;
+        world->enemies.size[i] = EnemySize(id, state);
     }
+    return first;
 }
 
-// Simple euclidian distance equation
-float Distance(Vector2 a, Vector2 b) {
-    // √ (x₁-y₁)² + (x₂-y₂)²
-    return sqrtf(pow(b.x - a.x, 2) + pow(b.y - a.y, 2));
-}
-
-// Enemy update method
-void UpdateEnemy(Enemy * enemyPtr, float deltaTime, float scale) {
-    // Fade out a dieing enemy
-    if(enemyPtr->state == 1) {
-        // Split if a normal purple enemy (not small)
-        if(enemyPtr->id == 4 && enemyPtr->timer == 0) {
-            // Spawn three small slimes
-            for(int i = 0; i < 3; ++i) {
-                int enemyIndex = SpawnEnemy(4, 2);
-                enemies[enemyIndex].position = enemyPtr->position;
-                enemies[enemyIndex].rotation = -enemyPtr->rotation + (float)GetRandomValue(-10, 10) / 50.0f;
-                enemies[enemyIndex].timer = (float)GetRandomValue(10, 30) / 10.0f;
-            }
-            enemyPtr->id = 0;
-            SetScore(score + 1);
-            return;
-        }
+// PlaceEnemies puts a block of new enemies on the given edges, facing the player
+void PlaceEnemies(int start, int count, const int * edgeList, int edgeCount) {
+    // Pick positions first (in thousandths of the arena so any window size gets the same spawns)
+    for(int i = start; i < start + count; ++i) {
+        float x = RandomValue(-1000, 1000) / 1000.0f * world->arena.x;
+        float y = RandomValue(-1000, 1000) / 1000.0f * world->arena.y;
 
-        // Increment the timer
-        enemyPtr->timer += deltaTime;
+        // Snap enemy to one of the edges (offset by 0.1 times the window)
+        int edge = edgeCount > 1 ? edgeList[RandomValue(0, edgeCount - 1)] : edgeList[0];
+        if(edge == EDGE_LEFT)
+            x = -1.2f * world->arena.x;
+        else if(edge == EDGE_RIGHT)
+            x = 1.2f * world->arena.x;
+        else if(edge == EDGE_TOP)
+            y = -1.2f * world->arena.y;
+        else
+            y = 1.2f * world->arena.y;
 
-        // Delete enemy when 0.5s is elapsed
-        if(enemyPtr->timer > 0.5f) {
-            // Increment the players score (if not small purple slime)
-            if(!died && enemyPtr->id != 4)
-                SetScore(score + 1);
-            
-            enemyPtr->id = 0;
-        }
-        return;
+        world->enemies.x[i] = x;
+        world->enemies.y[i] = y;
+        world->enemies.lastX[i] = x;
+        world->enemies.lastY[i] = y;
     }
-    
-    // Kill the enemy if the player died
-    if(died)
-        enemyPtr->state = 1;
-
-    // Move the enemy the towards where it is facing
-    enemyPtr->position.x += sin(enemyPtr->rotation) * deltaTime * enemyPtr->speed * scale;
-    enemyPtr->position.y += cos(enemyPtr->rotation) * deltaTime * enemyPtr->speed * scale;
-
-    // Calculate bounds
-    enemyPtr->bounds = (Rectangle){
-        enemyPtr->position.x - scale,
-        enemyPtr->position.y - scale,
-        scale * 2,
-        scale * 2
-    };
 
-    // Bounds are smaller for small purple slime and pink slimes
-    if(enemyPtr->id == 4 && enemyPtr->state >= 2 || enemyPtr->id == 5) {
-        enemyPtr->bounds = (Rectangle){
-            enemyPtr->position.x - scale / 2,
-            enemyPtr->position.y - scale / 2,
-            scale,
-            scale
-        };
+    // Then point every one at the player
+    for(int i = start; i < start + count; ++i)
+        SetEnemyRotation(i, SimAtan2(-world->enemies.x[i], -world->enemies.y[i]));
+}
+
+// SpawnEnemy is used to create a single enemy on any edge, it returns the new enemy's index (or -1 if there is no room)
+int SpawnEnemy(int id, int state) {
+    static const int allEdges[4] = {EDGE_LEFT, EDGE_RIGHT, EDGE_TOP, EDGE_BOTTOM};
+    int index = SpawnEnemies(id, state, 1);
+    if(index >= 0)
+        PlaceEnemies(index, 1, allEdges, 4);
+    return index;
+}
+
+// Works out a wave's lookup tables, must be called after changing a wave
+void PrepareWave(Wave * wave) {
+    int total = 0;
+    wave->mixEnds[0] = 0;
+    for(int id = 1; id <= ENEMY_TYPES; ++id) {
+        total += wave->mix[id] > 0 ? wave->mix[id] : 0;
+        wave->mixEnds[id] = total;
     }
 
-    // Check collision with player (if not already dead)
-    if(CheckCollisionRecs(enemyPtr->bounds, playerRect) && enemyPtr->state != 2 && enemyPtr->state != 1) {
-        --hearts;
-        if(hearts <= 0)
-            died = true;
-        
-        enemyPtr->state = 1;
+    wave->edgeCount = 0;
+    for(int edge = EDGE_LEFT; edge <= EDGE_BOTTOM; edge <<= 1) {
+        if(wave->edges & edge)
+            wave->edgeList[wave->edgeCount++] = edge;
     }
-    
-    // Check shield collision
-    bool collide = false;
-    for(int i = 0; i < MAX_COLLISION_LINES; ++i) {
-        // Make sure the shields collision is rotated
-        Line rotatedLine = RotateLine(currentShield.lines[i], (rotation + 270) * DEG2RAD);
-        rotatedLine.a.x *= scale;
-        rotatedLine.a.y *= scale;
-        rotatedLine.b.x *= scale;
-        rotatedLine.b.y *= scale;
-        rotatedLine.a.x += center.x;
-        rotatedLine.a.y += center.y;
-        rotatedLine.b.x += center.x;
-        rotatedLine.b.y += center.y;
-
-        if(DEBUG)
-            DrawLineEx(rotatedLine.a, rotatedLine.b, 1, BLUE);
-
-        // Check if colliding with shield
-        if(LineRectCollision(rotatedLine, enemyPtr->bounds)) {
-            collide = true;
-            break;
-        }
+    if(wave->edgeCount == 0) {
+        // No edges means any edge
+        for(int edge = EDGE_LEFT; edge <= EDGE_BOTTOM; edge <<= 1)
+            wave->edgeList[wave->edgeCount++] = edge;
     }
-    if(collide) {
-        if(enemyPtr->id == 3 && enemyPtr->state != 4) {
-            if(enemyPtr->state != 2)
-                enemyPtr->rotation = -enemyPtr->rotation;
-            enemyPtr->state = 2;
-        }
-        else {
-            enemyPtr->state = 1;
-            
-            // Check for bonuses
-            if(Distance(center, enemyPtr->position) < scale * 2.5)
-                GetBonus(0); // Close call
-
-            if(killTimer < 0.3) {
-                if(bonusTime > 2)
-                    GetBonus(1);
-                else if(bonusId == 1)
-                    GetBonus(2);
-                else if(bonusId == 2 || bonusId == 3)
-                    GetBonus(3);
-                else
-                    GetBonus(1);
+}
+
+// SpawnWave spawns a whole wave at once, it returns how many enemies were made
+int SpawnWave(const Wave * wave) {
+    int total = wave->mixEnds[ENEMY_TYPES];
+    if(total <= 0 || wave->count <= 0)
+        return 0;
+
+    // Pick every enemy's type
+    int counts[ENEMY_TYPES + 1] = {0};
+    for(int i = 0; i < wave->count; ++i) {
+        int pick = RandomValue(0, total - 1);
+        int id = 1;
+        while(pick >= wave->mixEnds[id])
+            ++id;
+        ++counts[id];
+    }
+
+    // Then spawn each type as one block
+    int spawned = 0;
+    for(int id = 1; id <= ENEMY_TYPES; ++id) {
+        if(counts[id] == 0)
+            continue;
+        int start = SpawnEnemies(id, 0, counts[id]);
+        if(start < 0)
+            continue;
+
+        int count = world->typeEnds[id] - start;
+        PlaceEnemies(start, count, wave->edgeList, wave->edgeCount);
+        spawned += count;
+        TraceInstant("Spawn", id);
+    }
+    return spawned;
+}
+
+// Puts a timer into the wheel slot for its due tick, timers due further out go into coarser levels
+void InsertTimer(int timer) {
+    uint32_t delta = world->timers[timer].due - world->wheelTick;
+    uint32_t due = world->timers[timer].due;
+    int level = 0;
+    while(level < WHEEL_LEVELS - 1 && delta >= 1u << (WHEEL_BITS * (level + 1)))
+        ++level;
+
+    // Timers past the end of the wheel wait in the last slot it reaches and get sorted again from there
+    if(delta >= 1u << (WHEEL_BITS * WHEEL_LEVELS))
+        due = world->wheelTick + (1u << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+    int slot = due >> (WHEEL_BITS * level) & (WHEEL_SLOTS - 1);
+    world->timers[timer].next = world->wheel[level][slot];
+    world->wheel[level][slot] = timer;
+}
+
+// Hands a timer back (it must already be out of the wheel)
+void FreeTimer(int timer) {
+    world->timers[timer].next = world->freeTimer;
+    world->freeTimer = timer;
+}
+
+// Cancels an enemy's scheduled transition, the timer stays in its slot until the wheel reaches it
+void CancelTimer(int index) {
+    int timer = world->enemies.timer[index];
+    if(timer < 0)
+        return;
+
+    world->timers[timer].enemy = -1;
+    world->enemies.timer[index] = -1;
+    --world->pendingTimers;
+}
+
+// Schedules an enemy transition the given amount of ticks from now (at least 1), replacing the enemy's last one
+void ScheduleTimer(int index, int kind, int ticks) {
+    CancelTimer(index);
+
+    // Take a free timer, growing the array once every timer is in use
+    int timer = world->freeTimer;
+    if(timer >= 0)
+        world->freeTimer = world->timers[timer].next;
+    else {
+        if(world->timerUsed == world->timerCapacity) {
+            int capacity = world->timerCapacity ? world->timerCapacity * 2 : 256;
+            Timer * timers = (Timer *)realloc(world->timers, capacity * sizeof(Timer));
+
+            // Without its timer a dieing enemy would never be removed (or a slime never split), so the game can't go on
+            if(!timers) {
+                printf("Out of memory for %d enemy timers\n", capacity);
+                fflush(stdout);
+                abort();
             }
-            killTimer = 0;
+
+            world->timers = timers;
+            world->timerCapacity = capacity;
         }
+        timer = world->timerUsed++;
     }
 
-    // Per enemy types actions
-    switch(enemyPtr->id) {
-        case 3:
-            if(enemyPtr->state == 2) {
-                enemyPtr->timer += deltaTime;
-                enemyPtr->rotation += deltaTime * PI / 2;
-                if(enemyPtr->timer >= 2) {
-                    enemyPtr->timer = 0;
-                    enemyPtr->state = 4;
-                    enemyPtr->rotation = atan2(center.x - enemyPtr->position.x, center.y - enemyPtr->position.y);
-                }
-            }
-            break;
-        case 4:
-            if(enemyPtr->state == 2) {
-                if(enemyPtr->timer >= 0)
-                    enemyPtr->timer -= deltaTime;
-                else {
-                    enemyPtr->timer = 0;
-                    enemyPtr->rotation = atan2(center.x - enemyPtr->position.x, center.y - enemyPtr->position.y);
-                }
-            }
+    world->timers[timer] = (Timer){index, kind, world->wheelTick + (ticks > 1 ? ticks : 1), -1};
+    world->enemies.timer[index] = timer;
+    ++world->pendingTimers;
+    InsertTimer(timer);
+}
+
+// Removes every timer (the timer memory is kept)
+void ClearTimers(World * oldWorld) {
+    oldWorld->timerUsed = 0;
+    oldWorld->freeTimer = -1;
+    oldWorld->pendingTimers = 0;
+    memset(oldWorld->wheel, -1, sizeof(oldWorld->wheel));
+}
+
+// RemoveEnemy frees an enemy, the last enemy of its type and of every later type move down to keep them sorted
+// Only enemies after index can move, so loops that remove enemies should run backwards
+void RemoveEnemy(int index) {
+    CancelTimer(index);
+    int id = world->enemies.id[index];
+    for(int type = id; type <= ENEMY_TYPES; ++type) {
+        int last = --world->typeEnds[type];
+        if(last != index)
+            MoveEnemy(last, index);
+        index = last;
+    }
+    --world->enemyCount;
+}
+
+// Removes every enemy
+void ClearEnemies() {
+    world->enemyCount = 0;
+    memset(world->typeEnds, 0, sizeof(world->typeEnds));
+    ClearTimers(world);
+}
+
+// Spawns enemy without a provided state
+int SpawnDefaultEnemy(int id) {
+    return SpawnEnemy(id, 0);
+}
+
+// Changes the score and updates enemy level
+void SetScore(int newScore) {
+    // Set the score
+    world->score = newScore;
+
+    // Reset enemy level on score reset
+    if(world->score <= 0) {
+        world->enemyLevel = 0;
+        return;
+    }
+
+    // Update the enemy level
+    for(int i = 0; i < ENEMY_TYPES; ++i) {
+        if(world->levelScores[i] == world->score) {
+            world->enemyLevel = i;
+
+            // Get the "Milestone" bonus
+            GetBonus(4);
+        }
+    }
+}
+
+// Simple euclidian distance equation
+float Distance(Vector2 a, Vector2 b) {
+    // √ (x₁-y₁)² + (x₂-y₂)²
+    // Squared in double like pow(x, 2), without depending on how each libm's pow rounds
+    double x = b.x - a.x;
+    double y = b.y - a.y;
+    return sqrtf(x * x + y * y);
+}
+
+// Distance without the square root, for comparing against a squared distance
+float DistanceSquared(Vector2 a, Vector2 b) {
+    float x = b.x - a.x;
+    float y = b.y - a.y;
+    return x * x + y * y;
+}
+
+// Gets a collision line of the current shield in world space
+Line ShieldLine(int i) {
+    // Make sure the shields collision is rotated
+    return RotateLine(world->currentShield.lines[i], (world->rotation + 270) * DEG2RAD);
+}
+
+// Rebuilds the world space shield collision geometry (done once per tick)
+void UpdateShieldGeometry() {
+    world->shieldLineCount = 0;
+    world->shieldInner = INFINITY;
+    world->shieldOuter = 0;
+
+    for(int i = 0; i < MAX_COLLISION_LINES; ++i) {
+        // Unused collision lines are left zeroed
+        Line line = world->currentShield.lines[i];
+        if(line.a.x == line.b.x && line.a.y == line.b.y)
+            continue;
+
+        // Get the line's end points (the center is the origin)
+        line = ShieldLine(i);
+        Vector2 a = line.a;
+        Vector2 b = line.b;
+
+        // Find the closest point on the line to the center
+        Vector2 ab = {b.x - a.x, b.y - a.y};
+        float t = Clamp(-(a.x * ab.x + a.y * ab.y) / (ab.x * ab.x + ab.y * ab.y), 0, 1);
+        Vector2 closest = {a.x + ab.x * t, a.y + ab.y * t};
+
+        // Widen the ring to fit the line
+        world->shieldInner = fminf(world->shieldInner, sqrtf(closest.x * closest.x + closest.y * closest.y));
+        world->shieldOuter = fmaxf(world->shieldOuter, sqrtf(fmaxf(a.x * a.x + a.y * a.y, b.x * b.x + b.y * b.y)));
+
+        // Store what the separating axis test needs
+        int n = world->shieldLineCount++;
+        world->shieldLines[n] = line;
+        world->shieldMins[n] = (Vector2){fminf(line.a.x, line.b.x), fminf(line.a.y, line.b.y)};
+        world->shieldMaxs[n] = (Vector2){fmaxf(line.a.x, line.b.x), fmaxf(line.a.y, line.b.y)};
+        world->shieldNormals[n] = (Vector2){line.a.y - line.b.y, line.b.x - line.a.x};
+        world->shieldDistances[n] = world->shieldNormals[n].x * line.a.x + world->shieldNormals[n].y * line.a.y;
+        world->shieldSpans[n] = fabsf(world->shieldNormals[n].x) + fabsf(world->shieldNormals[n].y);
+    }
+}
+
+// Checks if a shield line hits a square box (centered on x, y) using the separating axis test
+bool ShieldLineCollision(int line, float x, float y, float size) {
+    // The line's bounding box has to overlap the box
+    if(x - size > world->shieldMaxs[line].x || x + size < world->shieldMins[line].x ||
+       y - size > world->shieldMaxs[line].y || y + size < world->shieldMins[line].y)
+        return false;
+
+    // The box has to reach the line along the line's normal
+    float distance = world->shieldNormals[line].x * x + world->shieldNormals[line].y * y - world->shieldDistances[line];
+    return fabsf(distance) <= size * world->shieldSpans[line];
+}
+
+// Finds what a single enemy hits (the scalar version of CollideEnemies)
+unsigned char CollideEnemy(float x, float y, float size) {
+    unsigned char hits = 0;
+
+    // Check collision with the player
+    float reach = size + PLAYER_SIZE;
+    if(fabsf(x) < reach && fabsf(y) < reach)
+        hits |= HIT_PLAYER;
+
+    // Skip enemies outside of the ring that the shield is in
+    float radius = size * 1.4143f;
+    float outer = world->shieldOuter + radius;
+    float inner = fmaxf(world->shieldInner - radius, 0);
+    float distanceSqr = x * x + y * y;
+    if(distanceSqr > outer * outer || distanceSqr < inner * inner)
+        return hits;
+
+    // Check collision with the shield
+    for(int i = 0; i < world->shieldLineCount; ++i) {
+        if(ShieldLineCollision(i, x, y, size)) {
+            hits |= HIT_SHIELD;
             break;
-        case 5:
-            if(Distance(center, enemyPtr->position) < scale * 6 && enemyPtr->state == 0) {
-                enemyPtr->state = 2;
-                enemyPtr->rotation = -enemyPtr->rotation;
-                enemyPtr->timer = GetRandomValue(4, 8);
+        }
+    }
+    return hits;
+}
+
+// Moves enemies from start to end towards where they are facing (dieing enemies have no speed)
+void MoveEnemies(int start, int end, float step) {
+    int i = start;
+#if SIMD_WIDTH > 1
+    Floats steps = FloatsSet(step);
+    for(; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        Floats x = FloatsLoad(world->enemies.x + i);
+        Floats y = FloatsLoad(world->enemies.y + i);
+        Floats distance = FloatsMul(FloatsLoad(world->enemies.speed + i), steps);
+
+        // Remember where the enemies were so rendering can interpolate
+        FloatsStore(world->enemies.lastX + i, x);
+        FloatsStore(world->enemies.lastY + i, y);
+
+        FloatsStore(world->enemies.x + i, FloatsAdd(x, FloatsMul(FloatsLoad(world->enemies.directionX + i), distance)));
+        FloatsStore(world->enemies.y + i, FloatsAdd(y, FloatsMul(FloatsLoad(world->enemies.directionY + i), distance)));
+    }
+#endif
+
+    // Move the enemies left over from the last batch
+    for(; i < end; ++i) {
+        world->enemies.lastX[i] = world->enemies.x[i];
+        world->enemies.lastY[i] = world->enemies.y[i];
+        // Same order of operations as the batches so every SIMD width gets the same result
+        float distance = world->enemies.speed[i] * step;
+        world->enemies.x[i] += world->enemies.directionX[i] * distance;
+        world->enemies.y[i] += world->enemies.directionY[i] * distance;
+    }
+}
+
+// Finds what enemies from start to end hit this tick, the results are stored in enemies.hits
+// Every enemy is checked against the player and the shield here instead of through the grid: the check is a few SIMD
+// operations per enemy, less than putting the enemy in the grid costs, and the grid isn't built in most ticks
+void CollideEnemies(int start, int end) {
+    int i = start;
+#if SIMD_WIDTH > 1
+    Floats zero = FloatsSet(0);
+    Floats playerSize = FloatsSet(PLAYER_SIZE);
+
+    for(; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        Floats x = FloatsLoad(world->enemies.x + i);
+        Floats y = FloatsLoad(world->enemies.y + i);
+        Floats size = FloatsLoad(world->enemies.size + i);
+
+        // Check collision with the player
+        Floats reach = FloatsAdd(size, playerSize);
+        Floats player = FloatsAnd(
+            FloatsLess(FloatsAbs(x), reach),
+            FloatsLess(FloatsAbs(y), reach)
+        );
+
+        // Find the enemies within the ring that the shield is in
+        Floats distanceSqr = FloatsAdd(FloatsMul(x, x), FloatsMul(y, y));
+        Floats radius = FloatsMul(size, FloatsSet(1.4143f));
+        Floats outer = FloatsAdd(FloatsSet(world->shieldOuter), radius);
+        Floats inner = FloatsMax(FloatsSub(FloatsSet(world->shieldInner), radius), zero);
+        Floats shield = FloatsAnd(
+            FloatsLessEqual(distanceSqr, FloatsMul(outer, outer)),
+            FloatsLessEqual(FloatsMul(inner, inner), distanceSqr)
+        );
+
+        // Only run the separating axis test if an enemy is in the ring
+        if(FloatsMask(shield)) {
+            Floats lines = zero;
+            for(int j = 0; j < world->shieldLineCount; ++j) {
+                // The line's bounding box has to overlap the enemy
+                Floats overlap = FloatsAnd(
+                    FloatsAnd(
+                        FloatsLessEqual(FloatsSub(x, size), FloatsSet(world->shieldMaxs[j].x)),
+                        FloatsLessEqual(FloatsSet(world->shieldMins[j].x), FloatsAdd(x, size))
+                    ),
+                    FloatsAnd(
+                        FloatsLessEqual(FloatsSub(y, size), FloatsSet(world->shieldMaxs[j].y)),
+                        FloatsLessEqual(FloatsSet(world->shieldMins[j].y), FloatsAdd(y, size))
+                    )
+                );
+
+                // The enemy has to reach the line along the line's normal
+                Floats distance = FloatsSub(
+                    FloatsAdd(FloatsMul(FloatsSet(world->shieldNormals[j].x), x), FloatsMul(FloatsSet(world->shieldNormals[j].y), y)),
+                    FloatsSet(world->shieldDistances[j])
+                );
+                Floats axis = FloatsLessEqual(FloatsAbs(distance), FloatsMul(size, FloatsSet(world->shieldSpans[j])));
+
+                lines = FloatsOr(lines, FloatsAnd(overlap, axis));
             }
-            if(enemyPtr->state == 2) {
-                enemyPtr->timer -= deltaTime;
-                enemyPtr->rotation += deltaTime * 2;
-                enemyPtr->position = (Vector2) {
-                    sin(enemyPtr->rotation) * scale * 6 + center.x,
-                    -cos(enemyPtr->rotation) * scale * 6 + center.y
-                };
-
-                if(enemyPtr->timer <= 0) {
-                    enemyPtr->state = 3;
-                    enemyPtr->speed = 8;
-                    enemyPtr->rotation = -enemyPtr->rotation;
+            shield = FloatsAnd(shield, lines);
+        }
+
+        // Unpack the results
+        int playerMask = FloatsMask(player);
+        int shieldMask = FloatsMask(shield);
+        for(int lane = 0; lane < SIMD_WIDTH; ++lane)
+            world->enemies.hits[i + lane] = (playerMask >> lane & 1) * HIT_PLAYER | (shieldMask >> lane & 1) * HIT_SHIELD;
+    }
+#endif
+
+    // Check the enemies left over from the last batch
+    for(; i < end; ++i)
+        world->enemies.hits[i] = CollideEnemy(world->enemies.x[i], world->enemies.y[i], world->enemies.size[i]);
+}
+
+// Calculates the bounds of an enemy placed at the given position
+Rectangle EnemyBounds(int index, float x, float y) {
+    float size = world->enemies.size[index];
+    return (Rectangle){
+        x - size,
+        y - size,
+        size * 2,
+        size * 2
+    };
+}
+
+// Finds the grid cell a cell coordinate is hashed into
+static inline int GridCell(int cellX, int cellY) {
+    return (int)(((unsigned int)cellX * 73856093u ^ (unsigned int)cellY * 19349663u) & (world->grid.cellCount - 1));
+}
+
+// Finds the cell coordinate a position is in
+static inline int GridCoordinate(float position) {
+    return (int)floorf(position * (1 / GRID_CELL_SIZE));
+}
+
+// Works out what an enemy does to its neighbours (GRID_*)
+unsigned char GridFlags(int index) {
+    int state = world->enemies.state[index];
+    if(state == 1)
+        return 0;
+
+    const EnemyType * type = &enemyTypes[(int)world->enemies.id[index]];
+    unsigned char flags = type->pushSpeed > 0 ? GRID_PUSHES : 0;
+    if(type->behaviour == BEHAVIOUR_SPLIT && state == 2)
+        return flags | GRID_FRAGMENT;
+    return flags | GRID_HITTABLE;
+}
+
+// Finds which bucket of its cell an enemy goes in
+static inline int GridBucket(unsigned char flags) {
+    if(flags & GRID_FRAGMENT)
+        return 0;
+    return flags & GRID_PUSHES ? 1 : 2;
+}
+
+// Checks if any enemies can affect each other (the grid is only built then)
+bool GridNeeded() {
+    for(int id = 1; id <= ENEMY_TYPES; ++id) {
+        if(world->typeEnds[id] > world->typeEnds[id - 1] && (enemyTypes[id].pushSpeed > 0 || enemyTypes[id].behaviour == BEHAVIOUR_SPLIT))
+            return true;
+    }
+    return false;
+}
+
+// Finds how many enemies each chunk updates when the enemies are split into chunks (a multiple of the SIMD width)
+int EnemyChunkSize(int chunks) {
+    int size = (world->enemyCount + chunks - 1) / chunks;
+    return (size + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+}
+
+// Makes sure the grid has room for every enemy with cells for the placed enemies that go in, returns false if it couldn't
+bool ReserveGrid(int count, int placed) {
+    SpatialGrid * grid = &world->grid;
+
+    // Keep about two cells per enemy in the grid so most cells hold one or none
+    int cellCount = GRID_MIN_CELLS;
+    while(cellCount < placed * 2)
+        cellCount *= 2;
+    if(cellCount != grid->cellCount) {
+        int * bucketStarts = (int *)realloc(grid->bucketStarts, (cellCount * GRID_BUCKETS + 1) * sizeof(int));
+        if(!bucketStarts)
+            return false;
+        grid->bucketStarts = bucketStarts;
+        grid->cellCount = cellCount;
+    }
+
+    if(count <= grid->capacity)
+        return true;
+
+    // Grown in enemy chunks like the enemy store
+    int capacity = (count + ENEMY_CHUNK - 1) / ENEMY_CHUNK * ENEMY_CHUNK;
+    int * buckets = (int *)realloc(grid->buckets, capacity * sizeof(int));
+    GridEntry * entries = buckets ? (GridEntry *)realloc(grid->entries, capacity * sizeof(GridEntry)) : NULL;
+    int * order = entries ? (int *)realloc(grid->order, capacity * sizeof(int)) : NULL;
+
+    // Whatever was reallocated is kept (it's still valid), the grid just isn't built
+    if(buckets)
+        grid->buckets = buckets;
+    if(entries)
+        grid->entries = entries;
+    if(!order)
+        return false;
+    grid->order = order;
+    grid->capacity = capacity;
+    return true;
+}
+
+// Sorts the enemies that affect each other into the grid by where they are now, for an update split into chunks
+// Enemies are sorted by cell with a counting sort, so building is linear in the enemy count
+void BuildGrid(int chunks) {
+    SpatialGrid * grid = &world->grid;
+    grid->count = 0;
+    grid->pushers = 0;
+    grid->fragments = 0;
+    grid->maxSize = 0;
+    int count = world->enemyCount;
+
+    // Only small slimes look for the enemies that don't push, so those are left out when there are no small slimes
+    bool hittable = false;
+    for(int id = 1; id <= ENEMY_TYPES && !hittable; ++id) {
+        if(enemyTypes[id].behaviour != BEHAVIOUR_SPLIT)
+            continue;
+        for(int i = world->typeEnds[id - 1]; i < world->typeEnds[id] && !hittable; ++i)
+            hittable = world->enemies.state[i] == 2;
+    }
+    unsigned char wanted = GRID_PUSHES | GRID_FRAGMENT | (hittable ? GRID_HITTABLE : 0);
+
+    // At most the enemies of the types that can have a wanted flag go in
+    int placed = 0;
+    for(int id = 1; id <= ENEMY_TYPES; ++id) {
+        if(hittable || enemyTypes[id].pushSpeed > 0 || enemyTypes[id].behaviour == BEHAVIOUR_SPLIT)
+            placed += world->typeEnds[id] - world->typeEnds[id - 1];
+    }
+    if(!ReserveGrid(count, placed))
+        return;
+
+    // Count the enemies in every bucket (enemies that are left out get -1)
+    int bucketCount = grid->cellCount * GRID_BUCKETS;
+    memset(grid->bucketStarts, 0, (bucketCount + 1) * sizeof(int));
+    for(int i = 0; i < count; ++i) {
+        unsigned char flags = GridFlags(i);
+        if(!(flags & wanted)) {
+            grid->buckets[i] = -1;
+            continue;
+        }
+        int cell = GridCell(GridCoordinate(world->enemies.x[i]), GridCoordinate(world->enemies.y[i]));
+        int bucket = cell * GRID_BUCKETS + GridBucket(flags);
+        grid->buckets[i] = bucket;
+        ++grid->bucketStarts[bucket + 1];
+    }
+
+    // Turn the counts into where each bucket starts
+    for(int bucket = 0; bucket < bucketCount; ++bucket)
+        grid->bucketStarts[bucket + 1] += grid->bucketStarts[bucket];
+
+    // Place every enemy after the ones before it in its bucket (bucketStarts is shifted down a bucket while placing)
+    placed = 0;
+    for(int i = 0; i < count; ++i) {
+        if(grid->buckets[i] < 0)
+            continue;
+        int entry = grid->bucketStarts[grid->buckets[i]]++;
+        unsigned char flags = GridFlags(i);
+        grid->entries[entry] = (GridEntry){world->enemies.x[i], world->enemies.y[i], world->enemies.size[i], i, flags};
+        grid->pushers += (flags & GRID_PUSHES) != 0;
+        grid->fragments += (flags & GRID_FRAGMENT) != 0;
+        grid->maxSize = fmaxf(grid->maxSize, world->enemies.size[i]);
+        ++placed;
+    }
+
+    // Shift the starts back up
+    for(int bucket = bucketCount; bucket > 0; --bucket)
+        grid->bucketStarts[bucket] = grid->bucketStarts[bucket - 1];
+    grid->bucketStarts[0] = 0;
+    grid->count = placed;
+
+    // List each chunk's entries in grid order, so a chunk only goes through its own enemies
+    // and enemies that search the same cells do it one after another
+    int size = EnemyChunkSize(chunks);
+    memset(grid->chunkStarts, 0, sizeof(grid->chunkStarts));
+    for(int entry = 0; entry < placed; ++entry)
+        ++grid->chunkStarts[grid->entries[entry].enemy / size + 1];
+    for(int chunk = 0; chunk < chunks; ++chunk)
+        grid->chunkStarts[chunk + 1] += grid->chunkStarts[chunk];
+    int next[MAX_THREADS];
+    memcpy(next, grid->chunkStarts, sizeof(next));
+    for(int entry = 0; entry < placed; ++entry)
+        grid->order[next[grid->entries[entry].enemy / size]++] = entry;
+}
+
+// Lists the cells holding the grid entries centered in an area after the count cells already in cells, listing every cell once
+// Returns how many cells are listed, or -1 if the area covers more than GRID_MAX_CELLS (then every entry should be checked instead)
+int GridCells(float minX, float minY, float maxX, float maxY, int * cells, int count) {
+    int startX = GridCoordinate(minX);
+    int startY = GridCoordinate(minY);
+    int endX = GridCoordinate(maxX);
+    int endY = GridCoordinate(maxY);
+    if((endX - startX + 1) * (endY - startY + 1) > GRID_MAX_CELLS)
+        return -1;
+
+    // Different cell coordinates can hash to the same cell, those cells are only listed once
+    for(int cellY = startY; cellY <= endY; ++cellY) {
+        for(int cellX = startX; cellX <= endX; ++cellX) {
+            int cell = GridCell(cellX, cellY);
+            bool seen = false;
+            for(int j = 0; j < count && !seen; ++j)
+                seen = cells[j] == cell;
+            if(!seen)
+                cells[count++] = cell;
+        }
+    }
+    return count;
+}
+
+// Finds the range of buckets in a cell that can hold entries with any of the flags in mask (0 is every bucket)
+static inline void GridBucketRange(unsigned char mask, int * first, int * last) {
+    *first = !mask || (mask & (GRID_FRAGMENT | GRID_PUSHES)) ? 0 : 1;
+    *last = !mask || (mask & GRID_HITTABLE) ? 3 : mask & GRID_PUSHES ? 2 : 1;
+}
+
+// Finds the grid entries whose bounds overlap an area and have any of the flags in mask (0 finds every entry)
+// Only enemies that affect each other are in the grid (see BuildGrid), so this can't find everything near the player
+// Returns how many were found (at most capacity), entries are found in cell order so the same grid always gives the same results
+int QueryGrid(float minX, float minY, float maxX, float maxY, unsigned char mask, int * found, int capacity) {
+    SpatialGrid * grid = &world->grid;
+    if(grid->count == 0 || capacity <= 0)
+        return 0;
+
+    // Big areas cover more cells than there are entries, so every entry is checked instead
+    // The cell in the middle of the area is searched first, in a pile up it fills the results before the edge cells are searched
+    int foundCount = 0;
+    int cells[GRID_MAX_CELLS + 1];
+    // Enemies are sorted by their center, so the cells up to the widest enemy outside of the area can hold overlapping enemies
+    float reach = grid->maxSize;
+    cells[0] = GridCell(GridCoordinate((minX + maxX) / 2), GridCoordinate((minY + maxY) / 2));
+    int cellCount = GridCells(minX - reach, minY - reach, maxX + reach, maxY + reach, cells, 1);
+    if(cellCount < 0) {
+        for(int entry = 0; entry < grid->count && foundCount < capacity; ++entry) {
+            const GridEntry * other = &grid->entries[entry];
+            if((!mask || (other->flags & mask)) && other->x + other->size > minX && other->x - other->size < maxX && other->y + other->size > minY && other->y - other->size < maxY)
+                found[foundCount++] = entry;
+        }
+        return foundCount;
+    }
+
+    // Only search the buckets that can hold matching entries
+    int firstBucket, lastBucket;
+    GridBucketRange(mask, &firstBucket, &lastBucket);
+    for(int i = 0; i < cellCount; ++i) {
+        int first = cells[i] * GRID_BUCKETS + firstBucket;
+        int last = cells[i] * GRID_BUCKETS + lastBucket;
+        for(int entry = grid->bucketStarts[first]; entry < grid->bucketStarts[last]; ++entry) {
+            const GridEntry * other = &grid->entries[entry];
+            if(mask && !(other->flags & mask))
+                continue;
+            if(other->x + other->size <= minX || other->x - other->size >= maxX || other->y + other->size <= minY || other->y - other->size >= maxY)
+                continue;
+            found[foundCount++] = entry;
+            if(foundCount == capacity)
+                return foundCount;
+        }
+    }
+    return foundCount;
+}
+
+// Lets the enemies of a chunk affect their neighbours, runs after they have moved and collided
+// Slimes are pushed out of each other and small slimes hit other enemies (HIT_FRAGMENT)
+// Every enemy only changes itself, using where its neighbours were when the grid was built (so chunks can run in parallel)
+void InteractEnemies(int chunk, float deltaTime) {
+    SpatialGrid * grid = &world->grid;
+    bool pushing = grid->pushers > 1;
+    bool fragments = grid->fragments > 0;
+    if(grid->count == 0 || (!pushing && !fragments))
+        return;
+
+    // Enemies are visited in grid order instead of by index, so enemies that search the same cells do it one after another
+    // Only the chunk's own enemies are changed, so the results don't depend on how the enemies are split into chunks
+    int cells[GRID_MAX_CELLS + 1];
+    for(int k = grid->chunkStarts[chunk]; k < grid->chunkStarts[chunk + 1]; ++k) {
+        int self = grid->order[k];
+        int i = grid->entries[self].enemy;
+        unsigned char flags = grid->entries[self].flags;
+
+        // Small slimes and the enemies they run into hit each other, one overlap is enough
+        unsigned char hitMask = 0;
+        if(fragments && (flags & GRID_FRAGMENT))
+            hitMask = GRID_HITTABLE;
+        if(fragments && (flags & GRID_HITTABLE))
+            hitMask = GRID_FRAGMENT;
+
+        // Slimes are pushed by at most GRID_NEIGHBOURS other slimes
+        int pushLimit = pushing && (flags & GRID_PUSHES) ? GRID_NEIGHBOURS : 0;
+        if(!hitMask && !pushLimit)
+            continue;
+
+        // The enemy's own position when the grid was built (it has moved since)
+        float x = grid->entries[self].x;
+        float y = grid->entries[self].y;
+        float size = grid->entries[self].size;
+
+        // Hits and pushes are found in one search of the neighbouring cells, which stops once neither needs more entries
+        // The enemy's own cell is searched before the rest are listed, in a pile up it's usually enough
+        int firstBucket, lastBucket;
+        GridBucketRange(hitMask | (pushLimit ? GRID_PUSHES : 0), &firstBucket, &lastBucket);
+        int cellCount = 1;
+        cells[0] = GridCell(GridCoordinate(x), GridCoordinate(y));
+        bool hit = false;
+        int pushes = 0;
+        Vector2 push = {0, 0};
+        for(int c = 0; c < cellCount && ((hitMask && !hit) || pushes < pushLimit); ++c) {
+            int first = cells[c] * GRID_BUCKETS + firstBucket;
+            int last = cells[c] * GRID_BUCKETS + lastBucket;
+            for(int entry = grid->bucketStarts[first]; entry < grid->bucketStarts[last]; ++entry) {
+                const GridEntry * other = &grid->entries[entry];
+                float dx = x - other->x;
+                float dy = y - other->y;
+                float reach = size + other->size;
+
+                if((other->flags & hitMask) && !hit && fabsf(dx) < reach && fabsf(dy) < reach)
+                    hit = true;
+
+                // Slimes are pushed away from how far the other slimes overlap them
+                if((other->flags & GRID_PUSHES) && pushes < pushLimit) {
+                    float distanceSqr = dx * dx + dy * dy;
+                    if(other->enemy != i && distanceSqr < reach * reach) {
+                        ++pushes;
+
+                        // Slimes on the exact same spot (like a fresh split) are pushed apart sideways by index
+                        if(distanceSqr == 0)
+                            push.x += i < other->enemy ? -reach : reach;
+                        else {
+                            float distance = sqrtf(distanceSqr);
+                            float overlap = (reach - distance) / distance;
+                            push.x += dx * overlap;
+                            push.y += dy * overlap;
+                        }
+                    }
                 }
+
+                // A crowded cell isn't searched any further once nothing more is needed
+                if((!hitMask || hit) && pushes == pushLimit)
+                    break;
             }
-            break;
+
+            // List the other cells if the enemy's own cell wasn't enough (enemies are small, so the area is never too big to search by cell)
+            if(c == 0 && ((hitMask && !hit) || pushes < pushLimit))
+                cellCount = GridCells(x - size - grid->maxSize, y - size - grid->maxSize, x + size + grid->maxSize, y + size + grid->maxSize, cells, 1);
+        }
+        if(hit)
+            world->enemies.hits[i] |= HIT_FRAGMENT;
+
+        // Each slime moves out by half of the overlap (the other slime moves the other half), limited by its push speed
+        if(push.x != 0 || push.y != 0) {
+            float length = sqrtf(push.x * push.x + push.y * push.y);
+            float step = fminf(length / 2, enemyTypes[(int)world->enemies.id[i]].pushSpeed * deltaTime);
+            world->enemies.x[i] += push.x / length * step;
+            world->enemies.y[i] += push.y / length * step;
+        }
     }
 }
 
-// The DrawShop method contains all the code used to render the shop
-void DrawShop(float scale, float deltaTime) {
-    // Effecient way of doing a slide in/out animation
-    float xOffset = shopTimer > 0.2f ? 0 : windowSize.x - (shopTimer * windowSize.x * 5);
+// Queues an enemy event
+void PushEvent(EventBuffer * buffer, int type, int index, int value) {
+    // Grow the buffer (this rarely happens after the first few ticks)
+    if(buffer->count == buffer->capacity) {
+        int capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        EnemyEvent * events = (EnemyEvent *)realloc(buffer->events, capacity * sizeof(EnemyEvent));
+        if(!events)
+            return;
 
-    // Draw the shops background
-    DrawRectangleRec(
-        (Rectangle) {
-            scale * 3 + xOffset,
-            scale * 3,
-            windowSize.x - scale * 6,
-            windowSize.y - scale * 6
-        },
-        WHITE
-    );
+        buffer->events = events;
+        buffer->capacity = capacity;
+    }
 
-    // Draw the shops border
-    DrawRectangleLinesEx(
-        (Rectangle) {
-            scale * 3 + xOffset,
-            scale * 3,
-            windowSize.x - scale * 6,
-            windowSize.y - scale * 6
-        },
-        scale / 5,
-        BLACK
-    );
+    buffer->events[buffer->count++] = (EnemyEvent){type, index, value};
+}
 
-    // Draw shop title
-    DrawText("S H O P", center.x + xOffset - scale * 3.6f, scale * 4, scale * 2, BLACK);
+// Checks if an enemy is stuck where it can never be killed, so its slot would never be freed
+static inline bool EnemyLost(int index, int behaviour) {
+    int state = world->enemies.state[index];
+    if(state == 1)
+        return false;
 
-    // Get the position to display the next page button at
-    Vector2 arrowPos = (Vector2){windowSize.x - scale * 6.8f + xOffset, windowSize.y - scale * 6.8f};
-    // Images draw from the top left corner so the arrow's center is required to check hovering
-    Vector2 arrowCenter = (Vector2){arrowPos.x + scale * arrow.width / 24, arrowPos.y + scale * arrow.height / 24};
-    // Draw next page arrow (highlight if hovering)
-    if(Distance(GetMousePosition(), arrowCenter) < scale) {
-        DrawTextureEx(
-            arrow, 
-            arrowPos, 
-            0,
-            scale / 12,
-            WHITE
-        );
+    // Small slimes don't hurt the player, so once one reaches the player it sits under them out of the shield's reach
+    if(behaviour == BEHAVIOUR_SPLIT && state == 2)
+        return (world->enemies.hits[index] & HIT_PLAYER) != 0;
 
-        // Increment the page if mouse down
-        if(IsMouseButtonReleased(0)) {
-            ++shopPage;
+    // Spinning enemies turn back towards the player later on
+    if(behaviour == BEHAVIOUR_REFLECT && state == 2)
+        return false;
 
-            // Loop back around to 0 if page number is too high
-            if(shopPage * 3 > SHOP_ITEM_COUNT)
-                shopPage = 0;
+    // Enemies are spawned just outside the window, so only ones further out that are heading away can't come back
+    float x = world->enemies.x[index];
+    float y = world->enemies.y[index];
+    if(fabsf(x) < world->arena.x * RECLAIM_DISTANCE && fabsf(y) < world->arena.y * RECLAIM_DISTANCE)
+        return false;
+
+    // Heading away from the player (the player is at the origin)
+    return x * world->enemies.directionX[index] + y * world->enemies.directionY[index] > 0;
+}
+
+// Starts an enemy's death animation (dieing enemies don't move), a timer removes it once it's over
+static inline void KillEnemy(int index, int behaviour, EventBuffer * events) {
+    if(world->enemies.state[index] == 1)
+        return;
+
+    // Big slimes split right away instead of fading out
+    bool splits = behaviour == BEHAVIOUR_SPLIT && world->enemies.state[index] != 2;
+    SetEnemyState(index, 1);
+    world->enemies.speed[index] = 0;
+    PushEvent(events, EVENT_TIMER, index, splits ? TIMER_SPLIT : TIMER_REMOVE);
+}
+
+// Enemy update method, runs after the enemies have been moved and collided
+// Only the enemy itself is changed, everything else is queued in events (so enemies can update in parallel)
+// behaviour is a constant in every kernel, so each kernel only keeps the branches of its own behaviour
+__attribute__((always_inline)) static inline void UpdateEnemy(int index, const EnemyType * type, int behaviour, float deltaTime, EventBuffer * events) {
+    // Dieing enemies wait for their timer
+    if(world->enemies.state[index] == 1)
+        return;
+    
+    // Kill the enemy if the player died
+    if(world->died)
+        KillEnemy(index, behaviour, events);
+
+    // Check collision with player (if not already dead)
+    if((world->enemies.hits[index] & HIT_PLAYER) && world->enemies.state[index] != 2 && world->enemies.state[index] != 1) {
+        PushEvent(events, EVENT_HIT_PLAYER, index, 0);
+        KillEnemy(index, behaviour, events);
+    }
+    
+    // Check shield collision (running into a small slime is the same as hitting the shield)
+    if(world->enemies.hits[index] & (HIT_SHIELD | HIT_FRAGMENT)) {
+        if(behaviour == BEHAVIOUR_REFLECT && world->enemies.state[index] != 4) {
+            // Start spinning (hitting a spinning enemy doesn't restart its spin)
+            if(world->enemies.state[index] != 2) {
+                SetEnemyRotation(index, -world->enemies.rotation[index]);
+                PushEvent(events, EVENT_TIMER, index, TIMER_TURN);
+            }
+            SetEnemyState(index, 2);
+        }
+        else {
+            KillEnemy(index, behaviour, events);
+
+            // Bonuses are given out with the event (close call if near the player), only for shield kills
+            if(world->enemies.hits[index] & HIT_SHIELD)
+                PushEvent(events, EVENT_KILL, index, DistanceSquared((Vector2){0, 0}, (Vector2){world->enemies.x[index], world->enemies.y[index]}) < 2.5f * 2.5f);
+            else
+                PushEvent(events, EVENT_KILL, index, 2);
         }
     }
-    else {
-        DrawTextureEx(
-            arrow, 
-            arrowPos, 
-            0,
-            scale / 12,
-            RAYWHITE
-        );
+
+    // Per behaviour actions
+    switch(behaviour) {
+        case BEHAVIOUR_REFLECT:
+            // Spin until the turn timer sends it back (see FireTimer)
+            if(world->enemies.state[index] == 2)
+                SetEnemyRotation(index, world->enemies.rotation[index] + deltaTime * type->turnSpeed);
+            break;
+        case BEHAVIOUR_SPLIT:
+            // Home in once the launch timer has fired
+            if(world->enemies.state[index] == 2 && world->enemies.timer[index] < 0)
+                SetEnemyRotation(index, SimAtan2(-world->enemies.x[index], -world->enemies.y[index]));
+            break;
+        case BEHAVIOUR_ORBIT:
+            // The orbit time is picked with the event, orbiting starts next tick
+            if(DistanceSquared((Vector2){0, 0}, (Vector2){world->enemies.x[index], world->enemies.y[index]}) < type->orbitRadius * type->orbitRadius && world->enemies.state[index] == 0) {
+                SetEnemyState(index, 2);
+                SetEnemyRotation(index, -world->enemies.rotation[index]);
+                PushEvent(events, EVENT_TIMER, index, TIMER_EXIT);
+            }
+            else if(world->enemies.state[index] == 2) {
+                // Circle until the exit timer sends it back out
+                SetEnemyRotation(index, world->enemies.rotation[index] + deltaTime * type->turnSpeed);
+                world->enemies.x[index] = world->enemies.directionX[index] * type->orbitRadius;
+                world->enemies.y[index] = -world->enemies.directionY[index] * type->orbitRadius;
+            }
+            break;
     }
 
-    // Draw the shop items
-    for(int i = shopPage * 3; i<SHOP_ITEM_COUNT && i < 3 + shopPage * 3; ++i) {
-        Color itemColor = RAYWHITE;
+    // Free the slot of an enemy that can't be killed anymore
+    if(EnemyLost(index, behaviour))
+        PushEvent(events, EVENT_RECLAIM, index, 0);
+}
+
+// Generates the update loop of a behaviour, the compiler makes a copy of UpdateEnemy without the other behaviours
+#define ENEMY_KERNEL(name, behaviour) \
+    void name(int start, int end, const EnemyType * type, float deltaTime, EventBuffer * events) { \
+        for(int i = start; i < end; ++i) \
+            UpdateEnemy(i, type, behaviour, deltaTime, events); \
+    }
+
+ENEMY_KERNEL(UpdatePlainEnemies, BEHAVIOUR_PLAIN)
+ENEMY_KERNEL(UpdateReflectEnemies, BEHAVIOUR_REFLECT)
+ENEMY_KERNEL(UpdateSplitEnemies, BEHAVIOUR_SPLIT)
+ENEMY_KERNEL(UpdateOrbitEnemies, BEHAVIOUR_ORBIT)
+
+// The update loop of every behaviour
+typedef void (* EnemyKernel)(int start, int end, const EnemyType * type, float deltaTime, EventBuffer * events);
+EnemyKernel enemyKernels[BEHAVIOUR_COUNT] = {
+    UpdatePlainEnemies,
+    UpdateReflectEnemies,
+    UpdateSplitEnemies,
+    UpdateOrbitEnemies
+};
+
+// Moves, collides and updates one chunk of the enemies
+void UpdateEnemyChunk(int chunk, int chunks, float deltaTime) {
+    int size = EnemyChunkSize(chunks);
+    int start = chunk * size < world->enemyCount ? chunk * size : world->enemyCount;
+    int end = start + size < world->enemyCount ? start + size : world->enemyCount;
+
+    // Only the calling thread's chunk is profiled
+    if(chunk == 0)
+        ProfileBegin(PHASE_ENEMIES);
+    MoveEnemies(start, end, deltaTime);
+    if(chunk == 0) {
+        ProfileEnd(PHASE_ENEMIES);
+        ProfileBegin(PHASE_COLLISION);
+    }
+    CollideEnemies(start, end);
+    InteractEnemies(chunk, deltaTime);
+    if(chunk == 0) {
+        ProfileEnd(PHASE_COLLISION);
+        ProfileBegin(PHASE_ENEMIES);
+    }
+
+    // Every type's enemies are next to each other, so each type runs through its behaviour's loop
+    EventBuffer * events = &world->eventBuffers[chunk];
+    events->count = 0;
+    for(int id = 1; id <= ENEMY_TYPES; ++id) {
+        int typeStart = world->typeEnds[id - 1] > start ? world->typeEnds[id - 1] : start;
+        int typeEnd = world->typeEnds[id] < end ? world->typeEnds[id] : end;
+        if(typeStart < typeEnd)
+            enemyKernels[enemyTypes[id].behaviour](typeStart, typeEnd, &enemyTypes[id], deltaTime, events);
+    }
+    if(chunk == 0)
+        ProfileEnd(PHASE_ENEMIES);
+}
+
+// Worker thread entrypoint, waits for chunks of enemies to update
+void * EnemyWorker(void * argument) {
+    int chunk = (int)(intptr_t)argument;
+    int generation = 0;
+
+    pthread_mutex_lock(&workLock);
+    while(true) {
+        // Wait for new work
+        while(workGeneration == generation && !workStopping)
+            pthread_cond_wait(&workReady, &workLock);
+        if(workStopping)
+            break;
+
+        generation = workGeneration;
+        bool active = chunk < workChunks;
+        pthread_mutex_unlock(&workLock);
+
+        if(active) {
+            world = workWorld;
+            UpdateEnemyChunk(chunk, workChunks, workDeltaTime);
+        }
+
+        // Let the main thread know once every chunk is done
+        pthread_mutex_lock(&workLock);
+        if(active && --workPending == 0)
+            pthread_cond_signal(&workDone);
+    }
+    pthread_mutex_unlock(&workLock);
+    return NULL;
+}
+
+// Gets how many cores the computer has
+int CoreCount() {
+#ifdef _WIN32
+    return pthread_num_processors_np();
+#else
+    return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+// Starts the worker threads (count 0 uses every core)
+void InitWorkers(int count) {
+    if(count <= 0)
+        count = CoreCount();
+    if(count > MAX_THREADS)
+        count = MAX_THREADS;
+
+    threadCount = 1;
+    for(int i = 1; i < count; ++i) {
+        if(pthread_create(&workers[i], NULL, EnemyWorker, (void *)(intptr_t)i) != 0)
+            break;
+        ++threadCount;
+    }
+}
+
+// Stops the worker threads
+void CloseWorkers() {
+    pthread_mutex_lock(&workLock);
+    workStopping = true;
+    pthread_cond_broadcast(&workReady);
+    pthread_mutex_unlock(&workLock);
+
+    for(int i = 1; i < threadCount; ++i)
+        pthread_join(workers[i], NULL);
+    threadCount = 1;
+}
+
+// Schedules the transition an enemy queued, picking how long it takes
+void StartTimer(int index, int kind) {
+    const EnemyType * type = &enemyTypes[(int)world->enemies.id[index]];
+    switch(kind) {
+        case TIMER_REMOVE:
+            ScheduleTimer(index, kind, (int)(FADE_TIME * TICK_RATE));
+            break;
+        case TIMER_TURN:
+            ScheduleTimer(index, kind, (int)(type->turnTime * TICK_RATE));
+            break;
+        case TIMER_EXIT:
+            ScheduleTimer(index, kind, RandomValue(4, 8) * TICK_RATE);
+            break;
+        default:
+            // Slimes split on the next tick
+            ScheduleTimer(index, kind, 1);
+            break;
+    }
+}
+
+// Applies a transition once its timer is due
+void FireTimer(int index, int kind) {
+    const EnemyType * type = &enemyTypes[(int)world->enemies.id[index]];
+    switch(kind) {
+        case TIMER_REMOVE:
+            // The players score is incremented if alive (slimes score when they split instead)
+            if(!world->died && type->behaviour != BEHAVIOUR_SPLIT)
+                SetScore(world->score + 1);
+            RemoveEnemy(index);
+            break;
+        case TIMER_SPLIT: {
+            int id = world->enemies.id[index];
+            float x = world->enemies.x[index];
+            float y = world->enemies.y[index];
+            float rotation = world->enemies.rotation[index];
+            SetScore(world->score + 1);
+            RemoveEnemy(index);
+
+            // Spawn the small slimes where the slime was, they fly out for a while before homing in
+            int start = SpawnEnemies(id, 2, type->splitCount);
+            for(int enemyIndex = start; start >= 0 && enemyIndex < world->typeEnds[id]; ++enemyIndex) {
+                world->enemies.x[enemyIndex] = x;
+                world->enemies.y[enemyIndex] = y;
+                world->enemies.lastX[enemyIndex] = x;
+                world->enemies.lastY[enemyIndex] = y;
+                SetEnemyRotation(enemyIndex, -rotation + (float)RandomValue(-10, 10) / 50.0f);
+                ScheduleTimer(enemyIndex, TIMER_HOME, RandomValue(10, 30) * TICK_RATE / 10);
+            }
+            break;
+        }
+        case TIMER_TURN:
+            SetEnemyState(index, 4);
+            SetEnemyRotation(index, SimAtan2(-world->enemies.x[index], -world->enemies.y[index]));
+            break;
+        case TIMER_EXIT:
+            SetEnemyState(index, 3);
+            world->enemies.speed[index] = type->exitSpeed;
+            SetEnemyRotation(index, -world->enemies.rotation[index]);
+            break;
+    }
+}
+
+// Turns the timer wheel by a tick and fires every due timer
+// Only the due slot is touched, so enemies waiting on timers cost nothing until then
+void FireTimers() {
+    uint32_t tick = ++world->wheelTick;
+
+    // Once a level 0 lap is done, the next slot of the level above is sorted into the finer levels (and so on up)
+    for(int level = WHEEL_LEVELS - 1; level > 0; --level) {
+        if(tick & ((1u << (WHEEL_BITS * level)) - 1))
+            continue;
+
+        int slot = tick >> (WHEEL_BITS * level) & (WHEEL_SLOTS - 1);
+        int timer = world->wheel[level][slot];
+        world->wheel[level][slot] = -1;
+        while(timer >= 0) {
+            int next = world->timers[timer].next;
+            if(world->timers[timer].enemy >= 0)
+                InsertTimer(timer);
+            else
+                FreeTimer(timer);
+            timer = next;
+        }
+    }
+
+    // Every timer in the level 0 slot is due now
+    int slot = tick & (WHEEL_SLOTS - 1);
+    int timer = world->wheel[0][slot];
+    world->wheel[0][slot] = -1;
+    int splits = 0;
+    while(timer >= 0) {
+        // Firing can move enemies around (the timers follow them), so the enemy is read as late as possible
+        int next = world->timers[timer].next;
+        int index = world->timers[timer].enemy;
+        int kind = world->timers[timer].kind;
+        FreeTimer(timer);
+        if(index >= 0) {
+            world->enemies.timer[index] = -1;
+            --world->pendingTimers;
+            FireTimer(index, kind);
+            splits += kind == TIMER_SPLIT;
+        }
+        timer = next;
+    }
+
+    // Slime splits show chain reactions
+    if(splits > 0)
+        TraceInstant("Slime splits", splits);
+}
+
+// Applies the queued enemy events in enemy order, so the result doesn't depend on the thread count
+void ApplyEnemyEvents(int chunks) {
+    int kills = 0;
+    int reclaimed = 0;
+    for(int chunk = 0; chunk < chunks; ++chunk) {
+        EventBuffer * buffer = &world->eventBuffers[chunk];
+        for(int i = 0; i < buffer->count; ++i) {
+            EnemyEvent event = buffer->events[i];
+            switch(event.type) {
+                case EVENT_HIT_PLAYER:
+                    --world->hearts;
+                    if(world->hearts <= 0)
+                        world->died = true;
+                    break;
+                case EVENT_KILL:
+                    // Kills by small slimes don't give bonuses or keep kill streaks going (the player didn't make them)
+                    ++kills;
+                    if(event.value == 2)
+                        break;
+
+                    // Check for bonuses
+                    if(event.value == 1)
+                        GetBonus(0); // Close call
+
+                    if(world->killTimer < 0.3) {
+                        if(world->bonusTime > 2)
+                            GetBonus(1);
+                        else if(world->bonusId == 1)
+                            GetBonus(2);
+                        else if(world->bonusId == 2 || world->bonusId == 3)
+                            GetBonus(3);
+                        else
+                            GetBonus(1);
+                    }
+                    world->killTimer = 0;
+                    break;
+                case EVENT_TIMER:
+                    StartTimer(event.index, event.value);
+                    break;
+                case EVENT_RECLAIM:
+                    ++world->reclaimedEnemies;
+                    ++reclaimed;
+                    break;
+            }
+        }
+    }
+
+    // Mark bursts of kills (chain reactions show up here)
+    if(kills > 1)
+        TraceInstant("Kills", kills);
+    if(reclaimed > 0)
+        TraceInstant("Reclaimed", reclaimed);
+
+    // Remove enemies last, from the highest index down so the packing doesn't move queued enemies
+    for(int chunk = chunks - 1; chunk >= 0; --chunk) {
+        EventBuffer * buffer = &world->eventBuffers[chunk];
+        for(int i = buffer->count - 1; i >= 0; --i) {
+            if(buffer->events[i].type == EVENT_RECLAIM)
+                RemoveEnemy(buffer->events[i].index);
+        }
+    }
+}
+
+// Updates every enemy, splitting them across the worker threads when there are enough
+void UpdateEnemies(float deltaTime) {
+    // Apply the transitions that are due first, they can remove and spawn enemies
+    ProfileBegin(PHASE_ENEMIES);
+    FireTimers();
+    ProfileEnd(PHASE_ENEMIES);
+
+    // Only the main world uses the workers, batches of worlds are already spread over every core
+    int chunks = world == &mainWorld && world->enemyCount >= PARALLEL_ENEMIES ? threadCount : 1;
+
+    // Sort the enemies into the grid before they move, if any of them affect each other
+    ProfileBegin(PHASE_COLLISION);
+    if(GridNeeded())
+        BuildGrid(chunks);
+    else
+        world->grid.count = 0;
+    ProfileEnd(PHASE_COLLISION);
+
+    // Wake up the workers
+    if(chunks > 1) {
+        pthread_mutex_lock(&workLock);
+        workChunks = chunks;
+        workDeltaTime = deltaTime;
+        workWorld = world;
+        workPending = chunks - 1;
+        ++workGeneration;
+        pthread_cond_broadcast(&workReady);
+        pthread_mutex_unlock(&workLock);
+    }
+
+    UpdateEnemyChunk(0, chunks, deltaTime);
+
+    // Wait for the workers to finish
+    if(chunks > 1) {
+        pthread_mutex_lock(&workLock);
+        while(workPending > 0)
+            pthread_cond_wait(&workDone, &workLock);
+        pthread_mutex_unlock(&workLock);
+    }
+
+    ProfileBegin(PHASE_ENEMIES);
+    ApplyEnemyEvents(chunks);
+    ProfileEnd(PHASE_ENEMIES);
+}
+
+// UpdateGame advances the simulation by a single fixed tick
+void UpdateGame(float deltaTime) {
+    ++world->gameTick;
+
+    // The simulation is paused while the shop is open
+    if(world->shopOpen)
+        return;
+    double tickStart = traceFile != NULL ? Now() : 0;
+
+    // Only update timers if unpaused
+    world->killTimer += deltaTime;
+    world->bonusTime += deltaTime;
+
+    // Death specific actions
+    if(world->died)
+        world->deathTimer += deltaTime;
+    else {
+        ProfileBegin(PHASE_SPAWN);
+
+        // Update the spawn time based on score
+        world->spawnTime = world->spawnStart - world->score / world->spawnRamp;
+
+        // Don't lets enemies spawn faster than the minimum (half a second by default)
+        if(world->spawnTime <= world->spawnMin)
+            world->spawnTime = world->spawnMin;
+
+        // Count ticks (not seconds) so spawning doesn't drift with floating point time
+        int interval = (int)(world->spawnTime * TICK_RATE + 0.5f);
+        if(++world->spawnTicks >= interval) {
+            world->spawnTicks = 0;
+            SpawnWave(&world->waves[world->enemyLevel]);
+        }
+
+        ProfileEnd(PHASE_SPAWN);
+    }
+
+    // The shield only moves between ticks
+    ProfileBegin(PHASE_COLLISION);
+    UpdateShieldGeometry();
+    ProfileEnd(PHASE_COLLISION);
+
+    // Update all living enemies
+    UpdateEnemies(deltaTime);
+    TraceScope("Tick", tickStart, world->enemyCount);
+}
+
+// Checks if nothing in the world can change until an input arrives
+// (paused in the shop, or dead after the player, enemies and bonus text have faded out)
+bool WorldIdle() {
+    if(world->shopOpen)
+        return true;
+    return world->died && world->deathTimer >= 0.5f && world->enemyCount == 0 && world->bonusTime >= 2;
+}
+
+// Hashes the game state (to check that two runs match)
+unsigned int HashGame() {
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    int values[] = {world->score, world->coins, world->hearts, world->died, world->enemyLevel, world->enemyCount};
+    const unsigned char * bytes = (const unsigned char *)values;
+    for(size_t i = 0; i < sizeof(values); ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+
+    // Hash every enemy field that affects the simulation
+    const void * fields[] = {world->enemies.x, world->enemies.y, world->enemies.rotation, world->enemies.speed};
+    for(int field = 0; field < 4; ++field) {
+        bytes = (const unsigned char *)fields[field];
+        for(size_t i = 0; i < world->enemyCount * sizeof(float); ++i)
+            hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    for(int i = 0; i < world->enemyCount; ++i) {
+        hash = (hash ^ (unsigned char)(world->enemies.id[i] * 16 + world->enemies.state[i])) * 16777619u;
+
+        // Timers are hashed by how long they have left (where they are stored doesn't matter)
+        int timer = world->enemies.timer[i];
+        hash = (hash ^ (timer >= 0 ? world->timers[timer].due - world->wheelTick : 0)) * 16777619u;
+    }
+    return hash;
+}
+
+// Sets up a new world with the default settings, the shields must be loaded first
+void InitWorld(World * newWorld) {
+    memset(newWorld, 0, sizeof(World));
+    newWorld->currentShield = shields[0];
+    newWorld->enemyLimit = MAX_ENEMIES;
+    newWorld->hearts = 1;
+    newWorld->bonusTime = 2;
+    ClearTimers(newWorld);
+    memcpy(newWorld->levelScores, defaultLevelScores, sizeof(defaultLevelScores));
+    memcpy(newWorld->waves, defaultWaves, sizeof(defaultWaves));
+    for(int i = 0; i < ENEMY_TYPES; ++i)
+        PrepareWave(&newWorld->waves[i]);
+    newWorld->spawnTime = 2;
+    newWorld->spawnStart = 3;
+    newWorld->spawnRamp = 100;
+    newWorld->spawnMin = 0.5f;
+    newWorld->spawnTicks = (int)(newWorld->spawnStart * TICK_RATE / 2);    // The first wave comes after half an interval
+    newWorld->randomState = 0x2545F491;
+}
+
+// Frees the memory a world uses
+void FreeWorld(World * oldWorld) {
+    free(oldWorld->enemies.memory);
+    memset(&oldWorld->enemies, 0, sizeof(EnemyStore));
+    oldWorld->enemyCapacity = 0;
+    oldWorld->enemyCount = 0;
+    memset(oldWorld->typeEnds, 0, sizeof(oldWorld->typeEnds));
+
+    free(oldWorld->timers);
+    oldWorld->timers = NULL;
+    oldWorld->timerCapacity = 0;
+    ClearTimers(oldWorld);
+
+    for(int i = 0; i < MAX_THREADS; ++i) {
+        free(oldWorld->eventBuffers[i].events);
+        memset(&oldWorld->eventBuffers[i], 0, sizeof(EventBuffer));
+    }
+
+    free(oldWorld->grid.bucketStarts);
+    free(oldWorld->grid.buckets);
+    free(oldWorld->grid.entries);
+    free(oldWorld->grid.order);
+    memset(&oldWorld->grid, 0, sizeof(SpatialGrid));
+}
+
+// InitGame sets up the shields and the shop (shared by the windowed and headless builds)
+void InitGame() {
+    InitTrig();
+
+    // Init all the shields
+    shields[0] = (Shield){ // Basic shield
+        // Sprite
+        LoadSprite("resources/images/shield/basic.png"),
+        // Collision lines
+        {
+            (Line){{2.5, -1.6}, {2.5, 1.6}}
+        }
+    };
+    shields[1] = (Shield){ // Long shield
+        // Sprite
+        LoadSprite("resources/images/shield/long.png"),
+        // Collision lines
+        {
+            (Line){{2.5, -2.2}, {2.5, 2.2}}
+        }
+    };
+    shields[2] = (Shield){ // Armor shield
+        // Sprite
+        LoadSprite("resources/images/shield/armor.png"),
+        // Collision lines
+        {
+            (Line){{-1.4,  1.8}, {1.4, 1.8}},
+            (Line){{-1.4, -1.8}, {1.4, -1.8}}
+        }
+    };
+    shields[3] = (Shield){ // Boomerang shield
+        // Sprite
+        LoadSprite("resources/images/shield/boomarang.png"),
+        // Collision lines
+        {
+            (Line){{1.2,  1.8}, {2.9, 0}},
+            (Line){{1.2, -1.8}, {2.9, 0}}
+        }
+    };
+
+    // Load shop items
+    shopItems[0] = (ShopItem){
+        LoadSprite("resources/images/shop/heart.png"),
+        10,
+        1,
+        1
+    };
+    shopItems[1] = (ShopItem){
+        LoadSprite("resources/images/shop/long_shield.png"),
+        10,
+        0,
+        1
+    };
+    shopItems[2] = (ShopItem){
+        LoadSprite("resources/images/shop/armor_shield.png"),
+        40,
+        0,
+        2
+    };
+    shopItems[3] = (ShopItem){
+        LoadSprite("resources/images/shop/boomerang_shield.png"),
+        60,
+        0,
+        3
+    };
+
+    // Set up the game that is played
+    InitWorld(&mainWorld);
+}
+
+// ResetGame starts a new game after the player has died
+void ResetGame() {
+    world->died = false;
+    SetScore(0);
+    world->deathTimer = 0;
+    world->hearts = 1;
+
+    // Remove all enemies
+    ClearEnemies();
+}
+
+// Gets the scale (pixels per world unit) of a window, its diagonal is always 50 units long
+float WindowScale(float width, float height) {
+    return sqrt((double)width * width + (double)height * height) / 50;
+}
+
+// Fits the game to a new window size, returns the new scale (pixels per world unit)
+// Nothing in the world moves since it is in world units, only the camera changes
+float ResizeGame(float width, float height) {
+    // Update window size
+    world->windowSize.x = width;
+    world->windowSize.y = height;
+
+    // Get the window center
+    world->center.x = world->windowSize.x / 2;
+    world->center.y = world->windowSize.y / 2;
+
+    float scale = WindowScale(world->windowSize.x, world->windowSize.y);
+    world->arena.x = world->center.x / scale;
+    world->arena.y = world->center.y / scale;
+    return scale;
+}
+
+// Writes a number using as few bytes as it needs (7 bits per byte)
+void WriteVarint(FILE * file, uint32_t value) {
+    while(value >= 0x80) {
+        fputc((value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc(value, file);
+}
+
+// Reads a number written by WriteVarint
+bool ReadVarint(FILE * file, uint32_t * value) {
+    *value = 0;
+    for(int shift = 0; shift < 35; shift += 7) {
+        int byte = fgetc(file);
+        if(byte == EOF)
+            return false;
+
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Writes an input to the recording (if recording)
+void RecordInput(ReplayEvent event) {
+    if(recordFile == NULL)
+        return;
+
+    WriteVarint(recordFile, event.tick - replayTick);
+    fputc(event.type, recordFile);
+    replayTick = event.tick;
+
+    // Signed values are zigzag encoded so small negative numbers stay small
+    int values[] = {event.value, event.value2};
+    for(int i = 0; i < replayValues[event.type]; ++i)
+        WriteVarint(recordFile, ((uint32_t)values[i] << 1) ^ (uint32_t)(values[i] >> 31));
+}
+
+// Applies an input to the game and records it, returns the new scale
+float ApplyInput(ReplayEvent event, float scale) {
+    RecordInput(event);
+
+    switch(event.type) {
+        case REPLAY_ROTATE:
+            world->rotation = event.value;
+            break;
+        case REPLAY_SHOP:
+            world->shopOpen = !world->shopOpen;
+            break;
+        case REPLAY_BUY:
+            if(event.value >= 0 && event.value < SHOP_ITEM_COUNT)
+                BuyShopItem(event.value);
+            break;
+        case REPLAY_RESET:
+            ResetGame();
+            TraceInstant("Reset", 0);
+            break;
+        case REPLAY_RESIZE: {
+            double start = Now();
+            scale = ResizeGame(event.value, event.value2);
+            TraceScope("Resize", start, world->enemyCount);
+            break;
+        }
+    }
+    return scale;
+}
+
+// The replay flags of this build
+uint32_t ReplayFlags() {
+#ifdef DETERMINISTIC
+    return REPLAY_DETERMINISTIC;
+#else
+    return 0;
+#endif
+}
+
+// Starts recording every input with the seed and window size needed to play it back
+bool StartRecording(const char * fileName, unsigned int seed) {
+    recordFile = fopen(fileName, "wb");
+    if(recordFile == NULL)
+        return false;
+
+    fwrite("BCRP", 1, 4, recordFile);
+    fputc(REPLAY_VERSION, recordFile);
+    WriteVarint(recordFile, seed);
+    WriteVarint(recordFile, (uint32_t)world->windowSize.x);
+    WriteVarint(recordFile, (uint32_t)world->windowSize.y);
+    WriteVarint(recordFile, world->enemyLimit);
+    WriteVarint(recordFile, ReplayFlags());
+    replayTick = world->gameTick;
+    return true;
+}
+
+// Records the game's hash after a tick (if checks are being recorded)
+void RecordCheck() {
+    if(recordChecks)
+        RecordInput((ReplayEvent){world->gameTick, REPLAY_CHECK, (int)HashGame(), 0});
+}
+
+// Ends the recording with the game's hash so a playback can be checked
+void StopRecording() {
+    if(recordFile == NULL)
+        return;
+
+    RecordInput((ReplayEvent){world->gameTick, REPLAY_END, (int)HashGame(), 0});
+    fclose(recordFile);
+    recordFile = NULL;
+}
+
+// Reads the next input to play back
+bool ReadReplayEvent() {
+    uint32_t delta;
+    int type = 0;
+    if(!ReadVarint(replayFile, &delta) || (type = fgetc(replayFile)) == EOF || type < REPLAY_ROTATE || type > REPLAY_CHECK)
+        return false;
+
+    replayEvent = (ReplayEvent){replayTick + delta, type, 0, 0};
+    replayTick = replayEvent.tick;
+
+    uint32_t values[2] = {0, 0};
+    for(int i = 0; i < replayValues[type]; ++i) {
+        if(!ReadVarint(replayFile, &values[i]))
+            return false;
+    }
+    replayEvent.value = (int)((values[0] >> 1) ^ -(values[0] & 1));
+    replayEvent.value2 = (int)((values[1] >> 1) ^ -(values[1] & 1));
+    return true;
+}
+
+// Opens a recording and seeds the game from it, size is set to the recorded window size
+bool StartReplay(const char * fileName, Vector2 * size) {
+    replayFile = fopen(fileName, "rb");
+    if(replayFile == NULL)
+        return false;
+
+    char magic[4];
+    uint32_t seed, width, height, limit, flags;
+    if(
+        fread(magic, 1, 4, replayFile) != 4 || memcmp(magic, "BCRP", 4) != 0 ||
+        fgetc(replayFile) != REPLAY_VERSION ||
+        !ReadVarint(replayFile, &seed) ||
+        !ReadVarint(replayFile, &width) ||
+        !ReadVarint(replayFile, &height) ||
+        !ReadVarint(replayFile, &limit) ||
+        !ReadVarint(replayFile, &flags)
+    ) {
+        fclose(replayFile);
+        replayFile = NULL;
+        return false;
+    }
+
+    // It still plays, but only the same math is sure to give the same game
+    if(flags != ReplayFlags())
+        printf("Replay was recorded %s -DDETERMINISTIC, this build is %s it\n", flags & REPLAY_DETERMINISTIC ? "with" : "without", ReplayFlags() ? "with" : "without");
+    replayDrift = 0;
+
+    SeedRandom(seed);
+    world->enemyLimit = limit;
+    *size = (Vector2){(float)width, (float)height};
+    replayTick = world->gameTick;
+    if(!ReadReplayEvent())
+        replayEvent = (ReplayEvent){world->gameTick, REPLAY_END, 0, 0};
+    return true;
+}
+
+// Applies every input recorded before the next tick, returns false once the replay is over
+bool ReplayInputs(float * scale) {
+    if(replayFile == NULL)
+        return false;
+
+    while(replayEvent.tick <= world->gameTick) {
+        if(replayEvent.type == REPLAY_END) {
+            unsigned int hash = HashGame();
+            printf(
+                "Replay finished after %u ticks, hash %08x (recorded %08x) %s\n",
+                world->gameTick,
+                hash,
+                (unsigned int)replayEvent.value,
+                hash == (unsigned int)replayEvent.value ? "matches" : "DOES NOT MATCH"
+            );
+            if(replayDrift)
+                printf("Replay first drifted from the recording at tick %u\n", replayDrift);
+            fclose(replayFile);
+            replayFile = NULL;
+            return false;
+        }
+
+        // Checks aren't inputs, the game's hash is compared instead
+        if(replayEvent.type == REPLAY_CHECK) {
+            if(!replayDrift && HashGame() != (unsigned int)replayEvent.value)
+                replayDrift = replayEvent.tick;
+        }
+        else
+            *scale = ApplyInput(replayEvent, *scale);
+        if(!ReadReplayEvent()) {
+            printf("Replay is cut short after %u ticks\n", world->gameTick);
+            fclose(replayFile);
+            replayFile = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sleeps for the given amount of seconds
+void SleepSeconds(double seconds) {
+    if(seconds <= 0)
+        return;
+
+    struct timespec time;
+    time.tv_sec = (time_t)seconds;
+    time.tv_nsec = (long)((seconds - time.tv_sec) * 1e9);
+    nanosleep(&time, NULL);
+}
+
+// Remembers when a rotation was sampled, until the shield uses it
+void NoteInput(double time) {
+    if(latencyPending == 0)
+        latencyPending = time;
+}
+
+// Measures the input latency once a tick has moved the shield
+void NoteShieldUpdate() {
+    if(latencyPending == 0)
+        return;
+
+    latencyHistory[latencyCount % LATENCY_SAMPLES] = (float)((Now() - latencyPending) * 1000);
+    ++latencyCount;
+    latencyPending = 0;
+}
+
+// Prints the p50, p99 and max of the stored input latencies
+void PrintLatency(const char * name) {
+    int count = latencyCount < LATENCY_SAMPLES ? latencyCount : LATENCY_SAMPLES;
+    if(count == 0)
+        return;
+
+    qsort(latencyHistory, count, sizeof(float), CompareFloats);
+    printf(
+        "%s: input to shield update over %d inputs (ms): p50 %.3f p99 %.3f max %.3f\n",
+        name,
+        count,
+        latencyHistory[count * 50 / 100],
+        latencyHistory[count * 99 / 100],
+        latencyHistory[count - 1]
+    );
+}
+
+// Hands an input to the simulation, returns the new scale
+// The simulation thread applies it before its next tick, otherwise it's applied right away
+float SendInput(ReplayEvent event, float scale) {
+    double time = Now();
+    awakeUntil = time + IDLE_WAKE_TIME;
+    if(!simThreaded) {
+        scale = ApplyInput(event, scale);
+        if(event.type == REPLAY_ROTATE)
+            NoteInput(time);
+        return scale;
+    }
+
+    // Wait for room (the simulation thread empties the queue every tick, so this shouldn't happen)
+    while(inputHead - __atomic_load_n(&inputTail, __ATOMIC_ACQUIRE) >= INPUT_CAPACITY)
+        sched_yield();
+
+    inputQueue[inputHead % INPUT_CAPACITY] = (InputMessage){event, time};
+    __atomic_store_n(&inputHead, inputHead + 1, __ATOMIC_RELEASE);
+    return event.type == REPLAY_RESIZE ? WindowScale(event.value, event.value2) : scale;
+}
+
+// Runs a single tick after applying the inputs that are waiting (on whichever thread simulates)
+void SimulateTick(float * scale) {
+    unsigned int head = __atomic_load_n(&inputHead, __ATOMIC_ACQUIRE);
+    for(unsigned int tail = inputTail; tail != head; ++tail) {
+        // Inputs are recorded on the tick they are applied on
+        InputMessage message = inputQueue[tail % INPUT_CAPACITY];
+        message.event.tick = world->gameTick;
+        *scale = ApplyInput(message.event, *scale);
+        if(message.event.type == REPLAY_ROTATE)
+            NoteInput(message.time);
+    }
+    __atomic_store_n(&inputTail, head, __ATOMIC_RELEASE);
+
+    if(replayFile != NULL)
+        ReplayInputs(scale);
+    UpdateGame(TICK_TIME);
+
+    // The shield only moves while the game isn't paused
+    if(!world->shopOpen)
+        NoteShieldUpdate();
+}
+
+// Copies the world into a snapshot, reusing the snapshot's memory when it's big enough
+void TakeSnapshot(Snapshot * snapshot) {
+    World * copy = &snapshot->world;
+    EnemyStore enemies = copy->enemies;
+    int enemyCapacity = copy->enemyCapacity;
+    Timer * timers = copy->timers;
+    int timerCapacity = copy->timerCapacity;
+
+    // Grow the enemy arrays (laid out like the world's, see ReserveEnemies)
+    if(enemyCapacity < world->enemyCount) {
+        free(enemies.memory);
+        enemyCapacity = world->enemyCapacity;
+        char * memory = (char *)malloc(enemyCapacity * ENEMY_BYTES);
+        enemies.memory = memory;
+        enemies.x = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.y = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.lastX = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.lastY = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.directionX = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.directionY = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.rotation = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.speed = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.size = (float *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(float));
+        enemies.timer = (int *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(int));
+        enemies.id = (char *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(char));
+        enemies.state = (char *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(char));
+        enemies.hits = (unsigned char *)TakeEnemyArray(&memory, NULL, enemyCapacity, sizeof(unsigned char));
+    }
+    if(timerCapacity < world->timerUsed) {
+        free(timers);
+        timerCapacity = world->timerCapacity;
+        timers = (Timer *)malloc(timerCapacity * sizeof(Timer));
+    }
+
+    // Copy everything, then point the copy at the snapshot's own arrays
+    *copy = *world;
+    int count = world->enemyCount;
+    if(count > 0) {
+        memcpy(enemies.x, world->enemies.x, count * sizeof(float));
+        memcpy(enemies.y, world->enemies.y, count * sizeof(float));
+        memcpy(enemies.lastX, world->enemies.lastX, count * sizeof(float));
+        memcpy(enemies.lastY, world->enemies.lastY, count * sizeof(float));
+        memcpy(enemies.directionX, world->enemies.directionX, count * sizeof(float));
+        memcpy(enemies.directionY, world->enemies.directionY, count * sizeof(float));
+        memcpy(enemies.rotation, world->enemies.rotation, count * sizeof(float));
+        memcpy(enemies.speed, world->enemies.speed, count * sizeof(float));
+        memcpy(enemies.size, world->enemies.size, count * sizeof(float));
+        memcpy(enemies.timer, world->enemies.timer, count * sizeof(int));
+        memcpy(enemies.id, world->enemies.id, count * sizeof(char));
+        memcpy(enemies.state, world->enemies.state, count * sizeof(char));
+        memcpy(enemies.hits, world->enemies.hits, count * sizeof(unsigned char));
+    }
+    if(world->timerUsed > 0)
+        memcpy(timers, world->timers, world->timerUsed * sizeof(Timer));
+    copy->enemies = enemies;
+    copy->enemyCapacity = enemyCapacity;
+    copy->timers = timers;
+    copy->timerCapacity = timerCapacity;
+
+    // The render thread never handles events
+    memset(copy->eventBuffers, 0, sizeof(copy->eventBuffers));
+    memset(&copy->grid, 0, sizeof(SpatialGrid));
+
+    snapshot->time = Now();
+    snapshot->replaying = replayFile != NULL;
+}
+
+// Hands the finished tick to the render thread (simulation thread)
+void PublishSnapshot() {
+    // Pass on the time spent simulating so the profiler can show it
+    for(int i = 0; i < PHASE_COUNT; ++i) {
+        simProfileTotals[i] += profileTimes[i];
+        profileTimes[i] = 0;
+    }
+
+    Snapshot * snapshot = &snapshots[snapshotBack];
+    TakeSnapshot(snapshot);
+    memcpy(snapshot->profileTotals, simProfileTotals, sizeof(simProfileTotals));
+    snapshotBack = __atomic_exchange_n(&snapshotMiddle, snapshotBack | SNAPSHOT_FRESH, __ATOMIC_ACQ_REL) & ~SNAPSHOT_FRESH;
+}
+
+// Switches the render thread to the newest snapshot (if there is a newer one), returns the snapshot being drawn
+Snapshot * AcquireSnapshot() {
+    if(__atomic_load_n(&snapshotMiddle, __ATOMIC_ACQUIRE) & SNAPSHOT_FRESH) {
+        snapshotFront = __atomic_exchange_n(&snapshotMiddle, snapshotFront, __ATOMIC_ACQ_REL) & ~SNAPSHOT_FRESH;
+
+        // Add the simulation's time since the last snapshot to this frame's profile
+        Snapshot * snapshot = &snapshots[snapshotFront];
+        for(int i = 0; i < PHASE_COUNT; ++i) {
+            profileTimes[i] += (float)(snapshot->profileTotals[i] - drawnProfileTotals[i]);
+            drawnProfileTotals[i] = snapshot->profileTotals[i];
+        }
+    }
+
+    // The render thread only ever looks at its snapshot
+    world = &snapshots[snapshotFront].world;
+    return &snapshots[snapshotFront];
+}
+
+// Simulation thread entrypoint, runs ticks on its own clock and hands each one to the render thread
+void * SimulationThread(void * argument) {
+    profiling = true;
+    tracing = true;
+    traceRing = 1;
+    float scale = 1;
+    double nextTick = Now();
+    while(!__atomic_load_n(&simStopping, __ATOMIC_ACQUIRE)) {
+        // Stop ticking while nothing can change, inputs are still only stamped with ticks that ran (a replay always runs)
+        if(replayFile == NULL && WorldIdle() && __atomic_load_n(&inputHead, __ATOMIC_ACQUIRE) == inputTail) {
+            SleepSeconds(IDLE_POLL_TIME);
+            nextTick = Now();
+            continue;
+        }
+
+        double now = Now();
+        if(now < nextTick) {
+            SleepSeconds(nextTick - now);
+            continue;
+        }
+
+        // Give up on ticks that are too far behind (avoids a spiral of death)
+        if(now - nextTick > MAX_FRAME_TIME)
+            nextTick = now - MAX_FRAME_TIME;
+
+        SimulateTick(&scale);
+        PublishSnapshot();
+        nextTick += TICK_TIME;
+    }
+    return NULL;
+}
+
+// Moves the simulation onto its own thread, the calling thread draws snapshots from then on
+bool StartSimulation() {
+    // The render thread starts with a copy of the world as it is
+    snapshotFront = 0;
+    snapshotMiddle = 1;
+    snapshotBack = 2;
+    TakeSnapshot(&snapshots[snapshotFront]);
+    memset(simProfileTotals, 0, sizeof(simProfileTotals));
+    memset(drawnProfileTotals, 0, sizeof(drawnProfileTotals));
+
+    simStopping = false;
+    simThreaded = pthread_create(&simThread, NULL, SimulationThread, NULL) == 0;
+    return simThreaded;
+}
+
+// Stops the simulation thread, the calling thread goes back to the real world
+void StopSimulation() {
+    if(simThreaded) {
+        __atomic_store_n(&simStopping, true, __ATOMIC_RELEASE);
+        pthread_join(simThread, NULL);
+        simThreaded = false;
+    }
+    world = &mainWorld;
+
+    // Apply whatever inputs were still waiting
+    unsigned int head = inputHead;
+    for(; inputTail != head; ++inputTail) {
+        InputMessage message = inputQueue[inputTail % INPUT_CAPACITY];
+        message.event.tick = world->gameTick;
+        ApplyInput(message.event, 1);
+    }
+}
+
+// Frees the memory the snapshots use
+void FreeSnapshots() {
+    for(int i = 0; i < 3; ++i) {
+        free(snapshots[i].world.enemies.memory);
+        free(snapshots[i].world.timers);
+        memset(&snapshots[i].world, 0, sizeof(World));
+    }
+}
+
+#ifndef HEADLESS
+// Packs every loaded sprite's image into one atlas image
+Image PackSprites() {
+    Image images[MAX_SPRITES];
+
+    // Place the sprites in rows, with a pixel between them so they don't bleed into each other
+    int x = 0;
+    int y = 0;
+    int rowHeight = 0;
+    for(int i = 0; i < spriteCount; ++i) {
+        images[i] = LoadImage(spritePaths[i]);
+        if(x + images[i].width > ATLAS_WIDTH) {
+            x = 0;
+            y += rowHeight + 1;
+            rowHeight = 0;
+        }
+
+        sprites[i] = (Rectangle){(float)x, (float)y, (float)images[i].width, (float)images[i].height};
+        x += images[i].width + 1;
+        if(images[i].height > rowHeight)
+            rowHeight = images[i].height;
+    }
+
+    // Copy every image into the atlas
+    Image atlasImage = GenImageColor(ATLAS_WIDTH, y + rowHeight, BLANK);
+    for(int i = 0; i < spriteCount; ++i) {
+        ImageDraw(
+            &atlasImage,
+            images[i],
+            (Rectangle){0, 0, (float)images[i].width, (float)images[i].height},
+            sprites[i],
+            WHITE
+        );
+        UnloadImage(images[i]);
+    }
+
+    return atlasImage;
+}
+
+// Writes the packed and decoded sprites to an archive, so startup doesn't need to decode PNGs
+bool WriteArchive(const char * fileName) {
+    Image atlasImage = PackSprites();
+    ImageFormat(&atlasImage, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+    FILE * file = fopen(fileName, "wb");
+    if(file == NULL) {
+        UnloadImage(atlasImage);
+        return false;
+    }
+
+    // Write the header
+    ArchiveHeader header = {{'B', 'C', 'P', 'K'}, ARCHIVE_VERSION, (uint32_t)atlasImage.width, (uint32_t)atlasImage.height, (uint32_t)spriteCount};
+    fwrite(&header, sizeof(header), 1, file);
+
+    // Write where every sprite is
+    for(int i = 0; i < spriteCount; ++i) {
+        // Cleared first so the unused end of the path is written as zeros
+        ArchiveEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.path, spritePaths[i], sizeof(entry.path) - 1);
+        entry.x = sprites[i].x;
+        entry.y = sprites[i].y;
+        entry.width = sprites[i].width;
+        entry.height = sprites[i].height;
+        fwrite(&entry, sizeof(entry), 1, file);
+    }
+
+    // Write the atlas pixels
+    fwrite(atlasImage.data, 4, atlasImage.width * atlasImage.height, file);
+    bool written = ferror(file) == 0;
+    fclose(file);
+    UnloadImage(atlasImage);
+    return written;
+}
+
+// Uploads the atlas straight out of an archive in memory
+// Returns false if the archive is broken or is missing one of the loaded sprites
+bool LoadArchive(const unsigned char * data, size_t size) {
+    if(data == NULL || size < sizeof(ArchiveHeader))
+        return false;
+
+    ArchiveHeader header;
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, "BCPK", 4) != 0 || header.version != ARCHIVE_VERSION)
+        return false;
+
+    size_t pixelsOffset = sizeof(header) + header.count * sizeof(ArchiveEntry);
+    if(size < pixelsOffset + (size_t)header.width * header.height * 4)
+        return false;
+
+    // Find every loaded sprite inside the archive
+    for(int i = 0; i < spriteCount; ++i) {
+        bool found = false;
+        for(uint32_t j = 0; j < header.count && !found; ++j) {
+            ArchiveEntry entry;
+            memcpy(&entry, data + sizeof(header) + j * sizeof(entry), sizeof(entry));
+            if(strncmp(entry.path, spritePaths[i], sizeof(entry.path)) == 0) {
+                sprites[i] = (Rectangle){entry.x, entry.y, entry.width, entry.height};
+                found = true;
+            }
+        }
+
+        if(!found)
+            return false;
+    }
+
+    // The pixels are already decoded so they go to the GPU without a copy
+    Image atlasImage = {
+        (void *)(data + pixelsOffset),
+        (int)header.width,
+        (int)header.height,
+        1,
+        PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+    };
+    atlas = LoadTextureFromImage(atlasImage);
+    return atlas.id != 0;
+}
+
+// Loads the atlas from the sprite archive (embedded, then on disk) or by decoding every PNG
+// Returns where the sprites came from
+const char * BuildAtlas(bool forcePng) {
+    if(!forcePng) {
+#ifdef EMBED_ASSETS
+        if(LoadArchive(resources_sprites_pak, resources_sprites_pak_len))
+            return "embedded archive";
+#endif
+
+#ifndef _WIN32
+        // Map the archive so only the pages that get uploaded are read
+        int file = open(ARCHIVE_PATH, O_RDONLY);
+        if(file >= 0) {
+            struct stat info;
+            bool loaded = false;
+            if(fstat(file, &info) == 0 && info.st_size > 0) {
+                void * data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+                if(data != MAP_FAILED) {
+                    loaded = LoadArchive((const unsigned char *)data, info.st_size);
+                    munmap(data, info.st_size);
+                }
+            }
+            close(file);
+
+            if(loaded)
+                return "mapped archive";
+        }
+#else
+        // Windows has no mmap, so the archive is read in one go
+        FILE * file = fopen(ARCHIVE_PATH, "rb");
+        if(file != NULL) {
+            fseek(file, 0, SEEK_END);
+            long size = ftell(file);
+            fseek(file, 0, SEEK_SET);
+
+            bool loaded = false;
+            unsigned char * data = (unsigned char *)malloc(size > 0 ? size : 1);
+            if(data != NULL && fread(data, 1, size, file) == (size_t)size)
+                loaded = LoadArchive(data, size);
+            free(data);
+            fclose(file);
+
+            if(loaded)
+                return "archive";
+        }
+#endif
+    }
+
+    Image atlasImage = PackSprites();
+    atlas = LoadTextureFromImage(atlasImage);
+    UnloadImage(atlasImage);
+    return "png files";
+}
+
+// Registers every sprite that isn't part of the shields or shop
+void LoadSprites() {
+    // Load all the player sprites
+    playerSprites[0] = LoadSprite("resources/images/up.png");
+    playerSprites[1] = LoadSprite("resources/images/right.png");
+    playerSprites[2] = LoadSprite("resources/images/down.png");
+    playerSprites[3] = LoadSprite("resources/images/left.png");
+
+    // Load al the enemy sprites
+    enemySprite = LoadSprite("resources/images/enemies/enemy.png");
+    
+    // Load other sprites
+    coinSprite = LoadSprite("resources/images/coin.png");
+    arrowSprite = LoadSprite("resources/images/arrow.png");
+    heartSprite = LoadSprite("resources/images/heart.png");
+}
+
+// Moves a point from world space onto the screen (the camera follows the window's center and zooms by scale)
+Vector2 WorldToScreen(Vector2 position, float scale) {
+    return (Vector2){world->center.x + position.x * scale, world->center.y + position.y * scale};
+}
+
+// Moves a rectangle from world space onto the screen
+Rectangle WorldToScreenRec(Rectangle rec, float scale) {
+    return (Rectangle){world->center.x + rec.x * scale, world->center.y + rec.y * scale, rec.width * scale, rec.height * scale};
+}
+
+// Starts a batch of sprites, everything until EndSprites is sent to the GPU as one draw call
+void BeginSprites() {
+    rlSetTexture(atlas.id);
+    rlBegin(RL_QUADS);
+    ++spriteDrawCalls;
+}
+
+// Ends a batch of sprites
+void EndSprites() {
+    rlEnd();
+    rlSetTexture(0);
+}
+
+// Adds a sprite to the current batch (works like DrawTexturePro)
+void DrawSprite(int index, Rectangle dest, Vector2 origin, float rotation, Color tint, bool flip) {
+    // Texture coordinates of the sprite in the atlas
+    Rectangle source = sprites[index];
+    float left = source.x / atlas.width;
+    float right = (source.x + source.width) / atlas.width;
+    float top = source.y / atlas.height;
+    float bottom = (source.y + source.height) / atlas.height;
+    if(flip) {
+        float temp = left;
+        left = right;
+        right = temp;
+    }
+
+    // Find the corners of the sprite
+    Vector2 topLeft;
+    Vector2 topRight;
+    Vector2 bottomLeft;
+    Vector2 bottomRight;
+    if(rotation == 0) {
+        float x = dest.x - origin.x;
+        float y = dest.y - origin.y;
+        topLeft = (Vector2){x, y};
+        topRight = (Vector2){x + dest.width, y};
+        bottomLeft = (Vector2){x, y + dest.height};
+        bottomRight = (Vector2){x + dest.width, y + dest.height};
+    }
+    else {
+        float sinRotation = sinf(rotation * DEG2RAD);
+        float cosRotation = cosf(rotation * DEG2RAD);
+        float dx = -origin.x;
+        float dy = -origin.y;
+        topLeft = (Vector2){
+            dest.x + dx * cosRotation - dy * sinRotation,
+            dest.y + dx * sinRotation + dy * cosRotation
+        };
+        topRight = (Vector2){
+            dest.x + (dx + dest.width) * cosRotation - dy * sinRotation,
+            dest.y + (dx + dest.width) * sinRotation + dy * cosRotation
+        };
+        bottomLeft = (Vector2){
+            dest.x + dx * cosRotation - (dy + dest.height) * sinRotation,
+            dest.y + dx * sinRotation + (dy + dest.height) * cosRotation
+        };
+        bottomRight = (Vector2){
+            dest.x + (dx + dest.width) * cosRotation - (dy + dest.height) * sinRotation,
+            dest.y + (dx + dest.width) * sinRotation + (dy + dest.height) * cosRotation
+        };
+    }
+
+    // A full batch is flushed, which costs another draw call
+    if(rlCheckRenderBatchLimit(4))
+        ++spriteDrawCalls;
+
+    rlColor4ub(tint.r, tint.g, tint.b, tint.a);
+    rlNormal3f(0, 0, 1);
+    rlTexCoord2f(left, top);
+    rlVertex2f(topLeft.x, topLeft.y);
+    rlTexCoord2f(left, bottom);
+    rlVertex2f(bottomLeft.x, bottomLeft.y);
+    rlTexCoord2f(right, bottom);
+    rlVertex2f(bottomRight.x, bottomRight.y);
+    rlTexCoord2f(right, top);
+    rlVertex2f(topRight.x, topRight.y);
+    spriteVertices += 4;
+}
+
+// Adds a sprite to the current batch (works like DrawTextureEx without rotation)
+void DrawSpriteEx(int index, Vector2 position, float scale, Color tint) {
+    DrawSprite(
+        index,
+        (Rectangle){position.x, position.y, sprites[index].width * scale, sprites[index].height * scale},
+        (Vector2){0, 0},
+        0,
+        tint,
+        false
+    );
+}
+
+// Checks if a HUD text has to be laid out again for a new value or size
+bool HudTextStale(HudText * hud, int value, int fontSize) {
+    return !hud->built || hud->value != value || hud->fontSize != fontSize;
+}
+
+// Lays out the glyphs of a HUD text once (the same way DrawText places them) so drawing it is just copying quads
+void BuildHudText(HudText * hud, const char * text, int value, int fontSize) {
+    hud->built = true;
+    hud->value = value;
+    hud->fontSize = fontSize;
+    snprintf(hud->text, HUD_TEXT_LENGTH, "%s", text);
+    ++hudTextBuilds;
+
+    // DrawText's smallest size and spacing
+    Font font = GetFontDefault();
+    if(fontSize < 10)
+        fontSize = 10;
+    float scaleFactor = (float)fontSize / font.baseSize;
+    int spacing = fontSize / 10;
+    float padding = font.glyphPadding;
+
+    float x = 0;
+    float width = 0;
+    int length = 0;
+    hud->glyphCount = 0;
+    for(const char * c = hud->text; *c; ++c) {
+        int index = GetGlyphIndex(font, (unsigned char)*c);
+        GlyphInfo glyph = font.glyphs[index];
+        Rectangle rec = font.recs[index];
+
+        // Spaces only move the next glyph along
+        if(*c != ' ' && *c != '\t') {
+            hud->uvs[hud->glyphCount] = (Rectangle){
+                (rec.x - padding) / font.texture.width,
+                (rec.y - padding) / font.texture.height,
+                (rec.width + padding * 2) / font.texture.width,
+                (rec.height + padding * 2) / font.texture.height
+            };
+            hud->quads[hud->glyphCount] = (Rectangle){
+                x + (glyph.offsetX - padding) * scaleFactor,
+                (glyph.offsetY - padding) * scaleFactor,
+                (rec.width + padding * 2) * scaleFactor,
+                (rec.height + padding * 2) * scaleFactor
+            };
+            ++hud->glyphCount;
+        }
+
+        x += (glyph.advanceX == 0 ? rec.width : glyph.advanceX) * scaleFactor + spacing;
+        width += glyph.advanceX == 0 ? rec.width + glyph.offsetX : glyph.advanceX;
+        ++length;
+    }
+    hud->width = length > 0 ? (int)(width * scaleFactor + (length - 1) * spacing) : 0;
+}
+
+// Starts a batch of HUD texts, they all share the default font's texture so it's one draw call
+void BeginHudText() {
+    rlSetTexture(GetFontDefault().texture.id);
+    rlBegin(RL_QUADS);
+    ++spriteDrawCalls;
+}
+
+// Ends a batch of HUD texts
+void EndHudText() {
+    rlEnd();
+    rlSetTexture(0);
+}
+
+// Adds a laid out HUD text to the current batch
+void DrawHudText(HudText * hud, Vector2 position, Color tint) {
+    // DrawText only draws at whole pixels
+    position.x = (int)position.x;
+    position.y = (int)position.y;
+
+    if(rlCheckRenderBatchLimit(hud->glyphCount * 4))
+        ++spriteDrawCalls;
+
+    rlColor4ub(tint.r, tint.g, tint.b, tint.a);
+    rlNormal3f(0, 0, 1);
+    for(int i = 0; i < hud->glyphCount; ++i) {
+        Rectangle uv = hud->uvs[i];
+        Rectangle quad = hud->quads[i];
+        float x = position.x + quad.x;
+        float y = position.y + quad.y;
+        rlTexCoord2f(uv.x, uv.y);
+        rlVertex2f(x, y);
+        rlTexCoord2f(uv.x, uv.y + uv.height);
+        rlVertex2f(x, y + quad.height);
+        rlTexCoord2f(uv.x + uv.width, uv.y + uv.height);
+        rlVertex2f(x + quad.width, y + quad.height);
+        rlTexCoord2f(uv.x + uv.width, uv.y);
+        rlVertex2f(x + quad.width, y);
+    }
+    spriteVertices += hud->glyphCount * 4;
+}
+
+// Draws the profiler's percentiles and a graph of the last frame times
+void DrawProfiler(float scale) {
+    int fontSize = scale / 2 > 10 ? scale / 2 : 10;
+    int lineHeight = fontSize * 1.2f;
+    int x = scale / 2;
+    int y = scale * 4.5f;
+    int width = fontSize * 20;
+    int graphHeight = fontSize * 5;
+    DrawRectangle(x, y, width, lineHeight * (PHASE_COUNT + 2) + graphHeight + fontSize, (Color){0, 0, 0, 170});
+
+    // Percentiles of every phase (and the whole frame)
+    char str[64];
+    DrawText("ms            p50     p95     p99", x + fontSize / 2, y + fontSize / 2, fontSize, LIGHTGRAY);
+    for(int i = 0; i <= PHASE_COUNT; ++i) {
+        float percentiles[3];
+        ProfilePercentiles(i, percentiles);
+
+        int lineY = y + fontSize / 2 + lineHeight * (i + 1);
+        DrawText(phaseNames[i], x + fontSize / 2, lineY, fontSize, i == PHASE_COUNT ? YELLOW : WHITE);
+        for(int j = 0; j < 3; ++j) {
+            sprintf(str, "%.2f", percentiles[j]);
+            DrawText(str, x + fontSize * (9 + j * 3.5f), lineY, fontSize, i == PHASE_COUNT ? YELLOW : WHITE);
+        }
+    }
+
+    // Frame time graph, oldest on the left (the full height is 33ms)
+    int graphY = y + lineHeight * (PHASE_COUNT + 2) + fontSize / 2;
+    int graphWidth = width - fontSize;
+    for(int i = 0; i < profileFrameCount; ++i) {
+        int frame = (profileFrame - profileFrameCount + i + PROFILE_FRAMES) % PROFILE_FRAMES;
+        float frameTime = profileHistory[frame][PHASE_COUNT];
+        float height = frameTime / 33.3f * graphHeight;
+        if(height > graphHeight)
+            height = graphHeight;
+
+        DrawRectangle(
+            x + fontSize / 2 + i * graphWidth / PROFILE_FRAMES,
+            graphY + graphHeight - height,
+            graphWidth / PROFILE_FRAMES > 1 ? graphWidth / PROFILE_FRAMES : 1,
+            height,
+            frameTime > 16.7f ? RED : GREEN
+        );
+    }
+
+    // Mark 60 fps
+    DrawLine(x + fontSize / 2, graphY + graphHeight / 2, x + fontSize / 2 + graphWidth, graphY + graphHeight / 2, LIGHTGRAY);
+}
+
+// The DrawShop method contains all the code used to render the shop
+void DrawShop(float scale, float deltaTime) {
+    // Effecient way of doing a slide in/out animation
+    float xOffset = shopTimer > 0.2f ? 0 : world->windowSize.x - (shopTimer * world->windowSize.x * 5);
+
+    // Draw the shops background
+    DrawRectangleRec(
+        (Rectangle) {
+            scale * 3 + xOffset,
+            scale * 3,
+            world->windowSize.x - scale * 6,
+            world->windowSize.y - scale * 6
+        },
+        WHITE
+    );
+
+    // Draw the shops border
+    DrawRectangleLinesEx(
+        (Rectangle) {
+            scale * 3 + xOffset,
+            scale * 3,
+            world->windowSize.x - scale * 6,
+            world->windowSize.y - scale * 6
+        },
+        scale / 5,
+        BLACK
+    );
+
+    // Draw shop title
+    if(HudTextStale(&hudTexts[HUD_SHOP], 0, scale * 2))
+        BuildHudText(&hudTexts[HUD_SHOP], "S H O P", 0, scale * 2);
+    BeginHudText();
+    DrawHudText(&hudTexts[HUD_SHOP], (Vector2){world->center.x + xOffset - scale * 3.6f, scale * 4}, BLACK);
+    EndHudText();
+
+    // Get the position to display the next page button at
+    Vector2 arrowPos = (Vector2){world->windowSize.x - scale * 6.8f + xOffset, world->windowSize.y - scale * 6.8f};
+    // Images draw from the top left corner so the arrow's center is required to check hovering
+    Vector2 arrowCenter = (Vector2){arrowPos.x + scale * sprites[arrowSprite].width / 24, arrowPos.y + scale * sprites[arrowSprite].height / 24};
+
+    // Draw all of the shop's sprites in one batch
+    BeginSprites();
+
+    // Draw next page arrow (highlight if hovering)
+    if(DistanceSquared(GetMousePosition(), arrowCenter) < scale * scale) {
+        DrawSpriteEx(arrowSprite, arrowPos, scale / 12, WHITE);
+
+        // Increment the page if mouse down
+        if(IsMouseButtonReleased(0)) {
+            ++shopPage;
+
+            // Loop back around to 0 if page number is too high
+            if(shopPage * 3 > SHOP_ITEM_COUNT)
+                shopPage = 0;
+        }
+    }
+    else
+        DrawSpriteEx(arrowSprite, arrowPos, scale / 12, RAYWHITE);
+
+    // Draw the shop items
+    for(int i = shopPage * 3; i<SHOP_ITEM_COUNT && i < 3 + shopPage * 3; ++i) {
+        Color itemColor = RAYWHITE;
+
+        Vector2 position = (Vector2){
+            // Draw items relative to the center of the screen and offset image to be centered
+            world->center.x + (i - 1 - shopPage * 3) * scale * 11 - (sprites[shopItems[i].sprite].width * scale / 20) + xOffset,
+            scale * 8
+        };
+
+        // Check if the mouse is within the shop items bounds
+        if( GetMouseX() > position.x && 
+            GetMouseY() > position.y && 
+            GetMouseX() < position.x + sprites[shopItems[i].sprite].width * scale / 10 && 
+            GetMouseY() < position.y + sprites[shopItems[i].sprite].height * scale / 10
+        ) {
+            // Highlight selected item
+            itemColor = WHITE;
+
+            // Buy the item if clicked (and the player can afford it)
+            if(!replaying && IsMouseButtonReleased(0))
+                SendInput((ReplayEvent){world->gameTick, REPLAY_BUY, i, 0}, scale);
+        }
+
+        // Draw the item
+        DrawSpriteEx(shopItems[i].sprite, position, scale / 10, itemColor);
+    }
+
+    EndSprites();
+}
+
+// The target the game is drawn into when lowResHeight is set (zeroed like every global, its id is 0 until it's made)
+RenderTexture2D lowResTarget;
+
+// Gets how many window pixels each low resolution pixel covers (always a whole number)
+int LowResFactor() {
+    int factor = world->windowSize.y / lowResHeight;
+    return factor > 1 ? factor : 1;
+}
+
+// Makes the low resolution target cover the window, it's only recreated when the window's size changes
+void UpdateLowResTarget() {
+    int factor = LowResFactor();
+    int width = ((int)world->windowSize.x + factor - 1) / factor;
+    int height = ((int)world->windowSize.y + factor - 1) / factor;
+    if(lowResTarget.id != 0 && lowResTarget.texture.width == width && lowResTarget.texture.height == height)
+        return;
+
+    if(lowResTarget.id != 0)
+        UnloadRenderTexture(lowResTarget);
+    lowResTarget = LoadRenderTexture(width, height);
+    SetTextureFilter(lowResTarget.texture, TEXTURE_FILTER_POINT);
+}
+
+// Lays out the drawing code for a view of the given size (the window or the low resolution target)
+// Only rendering reads the window size and center, so this doesn't change the simulation
+void SetView(Vector2 size) {
+    world->windowSize = size;
+    world->center = (Vector2){size.x / 2, size.y / 2};
+}
+
+// Gets how visible the player is (they fade out after dieing)
+unsigned char PlayerAlpha() {
+    if(world->died)
+        return world->deathTimer < 0.5f ? (0.5f - world->deathTimer) * 510 : 0;
+    return 255;
+}
+
+// Draws the enemies, player and shield (everything that is in world space)
+// alpha is how far (0 to 1) the frame is between the last two ticks
+void DrawGame(float scale, float alpha) {
+    ProfileBegin(PHASE_ENEMY_DRAW);
+
+    // Draw the enemies, player and shield in one batch
+    BeginSprites();
+
+    // Render all enemies
+    for(int i = 0; i<world->enemyCount;++i) {
+        // Smooth out movement by interpolating between the last two ticks
+        Rectangle bounds = WorldToScreenRec(
+            EnemyBounds(i, Lerp(world->enemies.lastX[i], world->enemies.x[i], alpha), Lerp(world->enemies.lastY[i], world->enemies.y[i], alpha)),
+            scale
+        );
+
+        // Fade out a dead enemy
+        Color color = enemyPalette[world->enemies.id[i] - 1];
+        int timer = world->enemies.timer[i];
+        if(world->enemies.state[i] == 1 && timer >= 0 && world->timers[timer].kind == TIMER_REMOVE)
+            color.a = (unsigned char)Clamp((world->timers[timer].due - world->wheelTick) * TICK_TIME / FADE_TIME * 255, 0, 255);
+
+        // Render the enemy (flipped if looking left)
+        DrawSprite(enemySprite, bounds, (Vector2){0, 0}, 0, color, world->enemies.directionX[i] < 0);
+    }
+    ProfileEnd(PHASE_ENEMY_DRAW);
+    ProfileBegin(PHASE_HUD_DRAW);
+    
+    // Draw the player
+    unsigned char playerAlpha = PlayerAlpha();
+    Rectangle playerRect = WorldToScreenRec((Rectangle){-PLAYER_SIZE, -PLAYER_SIZE, PLAYER_SIZE * 2, PLAYER_SIZE * 2}, scale);
+    DrawSprite(
+        playerSprites[sprite], 
+        playerRect,
+        (Vector2){0, 0},
+        0,
+        (Color){
+            255,
+            255,
+            255,
+            playerAlpha
+        },
+        false
+    );
+
+    // Draw the players shield
+    DrawSprite(
+        world->currentShield.sprite,
+        (Rectangle) {
+            world->center.x,
+            world->center.y,
+            scale * 8,
+            scale * 4
+        },
+        (Vector2){
+            scale * 4, scale * 2
+        },
+        world->rotation - 90,
+        (Color){
+            255,
+            255,
+            255,
+            playerAlpha
+        },
+        false
+    );
+
+    EndSprites();
+    
+    // Draw debug lines
+    if(DEBUG) {
+        for(int i = 0; i < world->enemyCount; ++i) {
+            DrawRectangleLinesEx(
+                WorldToScreenRec(EnemyBounds(i, Lerp(world->enemies.lastX[i], world->enemies.x[i], alpha), Lerp(world->enemies.lastY[i], world->enemies.y[i], alpha)), scale),
+                1,
+                RED
+            );
+        }
+        DrawRectangleLinesEx(playerRect, 1, GREEN);
+        for(int i = 0; i < MAX_COLLISION_LINES; ++i) {
+            Line line = ShieldLine(i);
+            DrawLineEx(WorldToScreen(line.a, scale), WorldToScreen(line.b, scale), 1, BLUE);
+        }
+    }
+    ProfileEnd(PHASE_HUD_DRAW);
+}
+
+// Draws the score, coins, hearts, shop and death message (everything that is in screen space)
+void DrawHud(float scale, float deltaTime) {
+    ProfileBegin(PHASE_HUD_DRAW);
+
+    // Draw money icon and hearts in one batch
+    BeginSprites();
+    DrawSpriteEx(coinSprite, (Vector2){world->windowSize.x - scale * 2.5f, scale / 1.9f}, scale / 5, WHITE);
+
+    // Draw hearts
+    int remaining = world->hearts; // The remaining unrendered hearts
+    for(int i = 0; i < world->hearts; ++i) {
+        if(scale / 2 + scale * i * 2 > world->center.x) {
+            remaining -= i;
+            break;
+        }
+
+        DrawSpriteEx(heartSprite, (Vector2){scale / 2 + scale * i * 2, world->windowSize.y - scale * 2}, scale / 10, WHITE);
+    }
+
+    EndSprites();
+
+    // Draw UI, the texts are only laid out again when what they show changes
+    char str[255]; // Temp string for converting int to string
+    if(HudTextStale(&hudTexts[HUD_SCORE], world->score, scale * 2)) {
+        sprintf(str, "%d", world->score);
+        BuildHudText(&hudTexts[HUD_SCORE], str, world->score, scale * 2);
+    }
+    if(HudTextStale(&hudTexts[HUD_COINS], world->coins, scale * 2)) {
+        sprintf(str, "%d", world->coins);
+        BuildHudText(&hudTexts[HUD_COINS], str, world->coins, scale * 2);
+    }
+
+    BeginHudText();
+    DrawHudText(&hudTexts[HUD_SCORE], (Vector2){scale / 2, scale / 2}, BLACK);
+
+    // Draw money
+    DrawHudText(
+        &hudTexts[HUD_COINS],
+        (Vector2){world->windowSize.x - (TextLength(hudTexts[HUD_COINS].text) + 3) * scale, scale / 2},
+        BLACK
+    );
+
+    // Draw bonus (a bonus always gives the same reward so its id is enough to know when it changes)
+    if(world->bonusTime < 2) {
+        if(HudTextStale(&hudTexts[HUD_BONUS], world->bonusId, scale)) {
+            sprintf(str, "+%d %s", world->latestBonus.reward, world->latestBonus.name);
+            BuildHudText(&hudTexts[HUD_BONUS], str, world->bonusId, scale);
+        }
+
+        DrawHudText(
+            &hudTexts[HUD_BONUS],
+            (Vector2){world->windowSize.x - TextLength(hudTexts[HUD_BONUS].text) * scale / 1.8f, scale * 2.5f},
+            (Color){200, 200, 200, (unsigned char)(255 - 120 * world->bonusTime)}
+        );
+    }
+
+    // Draw text for the remaining hearts
+    if(remaining != world->hearts) {
+        if(HudTextStale(&hudTexts[HUD_HEARTS], remaining, scale * 1.2f)) {
+            sprintf(str, "+%d", remaining);
+            BuildHudText(&hudTexts[HUD_HEARTS], str, remaining, scale * 1.2f);
+        }
+
+        DrawHudText(&hudTexts[HUD_HEARTS], (Vector2){world->center.x + scale * 1.3f, world->windowSize.y - scale * 1.7f}, BLACK);
+    }
+    EndHudText();
+
+    // Underline score with the next enemy color
+    DrawRectangle(
+        scale / 2, 
+        scale * 2.2, 
+        hudTexts[HUD_SCORE].width, 
+        scale / 4, 
+        enemyPalette[world->enemyLevel]
+    );
+
+    // If shop is open or still in animation then render it
+    if(shopTimer > 0) {
+        ProfileEnd(PHASE_HUD_DRAW);
+        ProfileBegin(PHASE_SHOP_DRAW);
+        DrawShop(scale, deltaTime);
+        ProfileEnd(PHASE_SHOP_DRAW);
+        ProfileBegin(PHASE_HUD_DRAW);
+    }
+
+    // Draw enemy pool usage and sprite batching stats
+    if(DEBUG) {
+        sprintf(str, "%d/%d enemies, %d dropped, %d reclaimed, %d timers", world->enemyCount, world->enemyLimit, world->droppedSpawns, world->reclaimedEnemies, world->pendingTimers);
+        DrawText(str, scale / 2, scale * 3, scale / 2, RED);
+        sprintf(str, "%d sprite draw calls, %d vertices", spriteDrawCalls, spriteVertices);
+        DrawText(str, scale / 2, scale * 3.5f, scale / 2, RED);
+        sprintf(str, "%d HUD texts laid out", hudTextBuilds);
+        DrawText(str, scale / 2, scale * 4, scale / 2, RED);
+    }
+
+    // Draw the death message if player is dead
+    if(world->died) {
+        Color textColor = BLACK;
+        textColor.a = (unsigned char)(255 - PlayerAlpha());
+
+        if(HudTextStale(&hudTexts[HUD_DIED], 0, scale * 4))
+            BuildHudText(&hudTexts[HUD_DIED], "You died", 0, scale * 4);
+        if(HudTextStale(&hudTexts[HUD_CONTINUE], 0, scale))
+            BuildHudText(&hudTexts[HUD_CONTINUE], "Press any key to continue", 0, scale);
+
+        BeginHudText();
+        DrawHudText(
+            &hudTexts[HUD_DIED],
+            (Vector2){world->center.x - TextLength("You died") * scale, world->center.y - scale * 4},
+            textColor
+        );
+
+        // Make subtext more faded
+        textColor.a /= 2;
+        DrawHudText(
+            &hudTexts[HUD_CONTINUE],
+            (Vector2){world->center.x - TextLength("Press any key to continue") * scale / 4, world->center.y},
+            textColor
+        );
+        EndHudText();
+    }
+    ProfileEnd(PHASE_HUD_DRAW);
+}
+
+// Checks if the next frame would look the same as the last one until an input arrives
+bool SceneIdle() {
+    // A replay moves without inputs, and the profiler graphs every frame
+    if(replaying || profileOverlay || Now() < awakeUntil)
+        return false;
+
+    // The shop slides in and out
+    bool shopMoving = world->shopOpen ? shopTimer <= 0.2 : shopTimer > 0;
+    return !shopMoving && WorldIdle();
+}
+
+// The render method should contain all rendering code
+// alpha is how far (0 to 1) the frame is between the last two ticks
+void Render(float scale, float alpha, float deltaTime) {
+    // Clear the screen
+    ClearBackground(WHITE);
+    spriteDrawCalls = 0;
+    spriteVertices = 0;
+    hudTextBuilds = 0;
+
+    if(lowResHeight == 0) {
+        DrawGame(scale, alpha);
+        DrawHud(scale, deltaTime);
+    }
+    else {
+        // Lay everything out for the low resolution target while drawing into it
+        int factor = LowResFactor();
+        Vector2 windowSize = world->windowSize;
+        UpdateLowResTarget();
+        SetView((Vector2){(float)lowResTarget.texture.width, (float)lowResTarget.texture.height});
+
+        BeginTextureMode(lowResTarget);
+        ClearBackground(WHITE);
+        DrawGame(scale / factor, alpha);
+        if(lowResHud) {
+            // The shop's buttons are laid out in target pixels, so the mouse has to be too
+            SetMouseScale(1.0f / factor, 1.0f / factor);
+            DrawHud(scale / factor, deltaTime);
+            SetMouseScale(1, 1);
+        }
+        EndTextureMode();
+        SetView(windowSize);
+
+        // Scale the target up by a whole number so every pixel stays square (render textures are upside down)
+        ProfileBegin(PHASE_PRESENT);
+        DrawTexturePro(
+            lowResTarget.texture,
+            (Rectangle){0, 0, (float)lowResTarget.texture.width, -(float)lowResTarget.texture.height},
+            (Rectangle){0, 0, (float)lowResTarget.texture.width * factor, (float)lowResTarget.texture.height * factor},
+            (Vector2){0, 0},
+            0,
+            WHITE
+        );
+        ProfileEnd(PHASE_PRESENT);
+
+        // The HUD stays sharp at the window's resolution
+        if(!lowResHud)
+            DrawHud(scale, deltaTime);
+    }
+
+    // Draw the profiler on top of everything
+    if(profileOverlay)
+        DrawProfiler(scale);
+}
+
+// HandleInput contains all of the core user input processing code
+void HandleInput(float deltaTime) {
+    // Rotate player to look at the mouse
+    if(GetMouseX() >= 0 && GetMouseX() <= world->windowSize.x && GetMouseY() >= 0 && GetMouseY() <= world->windowSize.y) {
+        int newRotation = 180 - round((atan2(GetMousePosition().x - world->center.x, GetMousePosition().y - world->center.y) / 3.1415)*180);
+
+        // The snapshot can be a tick behind, so the last rotation sent is compared instead of the world's
+        if(newRotation != sentRotation) {
+            SendInput((ReplayEvent){world->gameTick, REPLAY_ROTATE, newRotation, 0}, 0);
+            sentRotation = newRotation;
+        }
+    }
+
+    // Space opens/closes the shop
+    if(IsKeyPressed(KEY_SPACE))
+        SendInput((ReplayEvent){world->gameTick, REPLAY_SHOP, 0, 0}, 0);
+}
+
+// Main method entrypoint
+int main(int argc, char ** argv) {
+    // Used to measure how long it takes to get to the first frame
+    double startTime = Now();
+
+    // The main thread is profiled and traced
+    profiling = true;
+    tracing = true;
+
+    // Frame time that hasn't been simulated yet
+    float tickAccumulator = 0;
+
+    // `--png` skips the sprite archive, to compare startup times with it
+    bool forcePng = argc > 1 && strcmp(argv[1], "--png") == 0;
+
+    // `--record <file> [seed]` saves every input, `--replay <file>` plays them back
+    const char * recordName = argc > 2 && strcmp(argv[1], "--record") == 0 ? argv[2] : NULL;
+    const char * replayName = argc > 2 && strcmp(argv[1], "--replay") == 0 ? argv[2] : NULL;
+    unsigned int seed = recordName && argc > 3 && argv[3][0] != '-' ? (unsigned int)strtoul(argv[3], NULL, 10) : (unsigned int)time(NULL);
+
+    // `--trace <file>` writes a Chrome trace of every frame (it can follow any other option)
+    const char * traceName = NULL;
+    for(int i = 1; i + 1 < argc; ++i) {
+        if(strcmp(argv[i], "--trace") == 0)
+            traceName = argv[i + 1];
+    }
+
+    // `--lowres [height]` draws the game at a low resolution and scales it up, `--lowres-hud` draws the HUD at it too
+    // `--single-thread` simulates between frames on the main thread instead of on the simulation thread
+    // `--profile` prints the startup time, and the frame timings and input latency on exit (so do `--trace` and opening the profiler with F3)
+    bool singleThread = false;
+    bool printTimings = traceName != NULL;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--lowres") == 0)
+            lowResHeight = i + 1 < argc && argv[i + 1][0] != '-' ? atoi(argv[i + 1]) : 270;
+        else if(strcmp(argv[i], "--lowres-hud") == 0)
+            lowResHud = true;
+        else if(strcmp(argv[i], "--single-thread") == 0)
+            singleThread = true;
+        else if(strcmp(argv[i], "--profile") == 0)
+            printTimings = true;
+    }
+
+    // `--pack [file]` writes the sprite archive and exits (no window needed)
+    if(argc > 1 && strcmp(argv[1], "--pack") == 0) {
+        const char * fileName = argc > 2 ? argv[2] : ARCHIVE_PATH;
+        InitGame();
+        LoadSprites();
+        if(!WriteArchive(fileName)) {
+            printf("Failed to write %s\n", fileName);
+            return 1;
+        }
+
+        printf("Packed %d sprites into %s\n", spriteCount, fileName);
+        return 0;
+    }
+
+    // Init the shields, shop and the world that is played
+    InitGame();
+    SeedRandom(seed);
+
+    // Set the starting window size (a replay keeps the recorded size)
+    world->windowSize = (Vector2){800, 500};
+    if(replayName && !StartReplay(replayName, &world->windowSize)) {
+        printf("Failed to read %s\n", replayName);
+        return 1;
+    }
+
+    // Init the window
+    if(!replayName)
+        SetConfigFlags(FLAG_WINDOW_RESIZABLE);
+    InitWindow(world->windowSize.x, world->windowSize.y, "Block-Cycle");
+
+    // Start a worker thread for every core (only used when there are lots of enemies)
+    InitWorkers(0);
+
+    // Pack every sprite into one texture
+    LoadSprites();
+    double atlasStart = Now();
+    const char * atlasSource = BuildAtlas(forcePng);
+    double atlasTime = Now() - atlasStart;
+
+    // Convert the enemy colors once instead of every draw
+    for(int i = 0; i < ENEMY_TYPES; ++i)
+        enemyPalette[i] = ColorFromVec3(enemyTypes[i + 1].color, 255);
+
+    // Get initial window size, center and the scale of objects on the window
+    float scale = 1;
+    if(replayName)
+        scale = ResizeGame(world->windowSize.x, world->windowSize.y);
+    else
+        scale = ResizeGame(GetRenderWidth(), GetRenderHeight());
+
+    // Start recording once the window size is known
+    if(recordName && !StartRecording(recordName, seed))
+        printf("Failed to record to %s\n", recordName);
+
+    // Time inbetween frames
+    float deltaTime;
+
+    // Start tracing once everything is loaded
+    if(traceName && !StartTrace(traceName))
+        printf("Failed to trace to %s\n", traceName);
+
+    // Hand the world to the simulation thread, this thread only samples input and draws from here on
+    // (input has to be read on the main thread, which waits on the present, so only the simulation can move)
+    if(!singleThread && !StartSimulation())
+        printf("Failed to start the simulation thread, simulating between frames\n");
+    const char * loopName = simThreaded ? "Simulation thread" : "Single thread";
+
+    // Main loop
+    while(!WindowShouldClose()) {
+        double frameStart = Now();
+
+        // Draw the newest tick the simulation thread has finished
+        Snapshot * snapshot = simThreaded ? AcquireSnapshot() : NULL;
+
+        // Inputs come from the replay instead of the player while playing one back
+        replaying = snapshot ? snapshot->replaying : replayFile != NULL;
+
+        // Update window metrics if window resized (the simulation thread's snapshots catch up a tick later)
+        if(!replaying && IsWindowResized())
+            scale = SendInput((ReplayEvent){world->gameTick, REPLAY_RESIZE, GetRenderWidth(), GetRenderHeight()}, scale);
+        if(snapshot)
+            scale = WindowScale(world->windowSize.x, world->windowSize.y);
+
+        // Update delta time (a very slow frame is only partly simulated)
+        deltaTime = GetFrameTime();
+        if(deltaTime > MAX_FRAME_TIME)
+            deltaTime = MAX_FRAME_TIME;
+
+        // The time spent waiting for input events while idle isn't simulated
+        if(idleFrames)
+            deltaTime = 0;
+
+        // Update the shop animation timer
+        if(world->shopOpen)
+            shopTimer += deltaTime;
+        else {
+            if(shopTimer > 0.2)
+                shopTimer = 0.2;
+            else if(shopTimer > 0)
+                shopTimer -= deltaTime;
+        }
+
+        // F3 shows the profiler
+        if(IsKeyPressed(KEY_F3)) {
+            profileOverlay = !profileOverlay;
+            printTimings = true;
+        }
+
+        // F4 switches between low and full resolution (to compare them with the profiler)
+        if(IsKeyPressed(KEY_F4))
+            lowResHeight = lowResHeight == 0 ? 270 : 0;
+
+        // Death specific actions (a replay already has all of its inputs)
+        ProfileBegin(PHASE_INPUT);
+        if(!replaying && !world->died) {
+            // Update all input
+            HandleInput(deltaTime);
+        }
+        else if(!replaying && world->shopOpen && IsKeyPressed(KEY_SPACE)) // Allow user to close shop if dead
+            SendInput((ReplayEvent){world->gameTick, REPLAY_SHOP, 0, 0}, scale);
+
+        ProfileEnd(PHASE_INPUT);
+
+        // Get the players sprite index
+        sprite = (int)round(world->rotation / 90) % 4;
+
+        // Wait for a keypress before resetting from death
+        if(!replaying && world->died && GetKeyPressed())
+            SendInput((ReplayEvent){world->gameTick, REPLAY_RESET, 0, 0}, scale);
+
+        // Run the simulation in fixed ticks to catch up with the frame (the simulation thread keeps its own time)
+        float alpha;
+        if(snapshot)
+            alpha = Clamp((Now() - snapshot->time) / TICK_TIME, 0, 1);
+        else {
+            tickAccumulator += deltaTime;
+            while(tickAccumulator >= TICK_TIME) {
+                SimulateTick(&scale);
+                tickAccumulator -= TICK_TIME;
+            }
+            alpha = tickAccumulator / TICK_TIME;
+        }
+
+        // Wait for input events instead of drawing at full rate while nothing moves (the wait is in EndDrawing)
+        bool idle = SceneIdle();
+        if(idle != idleFrames) {
+            if(idle)
+                EnableEventWaiting();
+            else
+                DisableEventWaiting();
+            idleFrames = idle;
+            TraceInstant(idle ? "Idle" : "Awake", 0);
+        }
+
+        // Draw everything
+        BeginDrawing();
+        Render(scale, alpha, deltaTime);
+        ProfileBegin(PHASE_PRESENT);
+        EndDrawing();
+        ProfileEnd(PHASE_PRESENT);
+
+        // Save this frame's timings (the real frame time, not the clamped one)
+        // An idle frame is mostly waiting, so it's left out of the profile
+        if(idle)
+            memset(profileTimes, 0, sizeof(profileTimes));
+        else
+            ProfileFrame(GetFrameTime());
+        TraceScope("Frame", frameStart, world->enemyCount);
+
+        // Report the cold start time once the first frame is shown (only when profiling, it's for measuring startup)
+        if(startTime > 0) {
+            if(printTimings) {
+                printf(
+                    "First frame after %.1f ms (sprites from %s in %.1f ms)\n",
+                    (Now() - startTime) * 1000,
+                    atlasSource,
+                    atlasTime * 1000
+                );
+            }
+            startTime = 0;
+        }
+    }
+
+    // Take the world back from the simulation thread
+    StopSimulation();
+
+    // Finish the recording and trace, then print the timings of the last frames if they were asked for
+    StopRecording();
+    StopTrace();
+    if(printTimings) {
+        PrintProfile();
+        PrintLatency(loopName);
+    }
+
+    // Unload everything and close the window
+    UnloadTexture(atlas);
+    if(lowResTarget.id != 0)
+        UnloadRenderTexture(lowResTarget);
+    CloseWorkers();
+    FreeWorld(world);
+    FreeSnapshots();
+    
+    CloseWindow();
+}
+#else
+// Aims the shield at the closest enemy in place of the mouse
+void HeadlessInput() {
+    int aim = world->rotation;
+    float closest = INFINITY;
+    for(int i = 0; i < world->enemyCount; ++i) {
+        // Ignore dieing enemies
+        if(world->enemies.state[i] == 1)
+            continue;
+
+        Vector2 position = {world->enemies.x[i], world->enemies.y[i]};
+        float distance = DistanceSquared((Vector2){0, 0}, position);
+        if(distance < closest) {
+            closest = distance;
+            aim = 180 - round((SimAtan2(position.x, position.y) / 3.1415)*180);
+        }
+    }
+
+    // Face the enemy with the shield's first line (the armor shield sits on the sides)
+    Line front = world->currentShield.lines[0];
+    aim -= (int)round(SimAtan2((front.a.y + front.b.y) / 2, (front.a.x + front.b.x) / 2) / DEG2RAD);
+
+    if(aim != world->rotation)
+        ApplyInput((ReplayEvent){world->gameTick, REPLAY_ROTATE, aim, 0}, 0);
+}
+
+// How many ticks the autoplayer waits between aiming (its reaction time)
+int autoplayReaction = 1;
+
+// Plays the game without a player, returns how many items it bought
+int Autoplay() {
+    // Aim at the closest enemy every so often
+    if(world->gameTick % autoplayReaction == 0)
+        HeadlessInput();
+
+    // Keep a few spare hearts (shop item 0)
+    if(world->hearts < 3) {
+        if(world->coins < shopItems[0].cost)
+            return 0;
+
+        ApplyInput((ReplayEvent){world->gameTick, REPLAY_BUY, 0, 0}, 0);
+        return 1;
+    }
+
+    // Then upgrade to the next shield in the shop (shields are told apart by their sprite)
+    int shield = 0;
+    for(int i = 0; i < SHIELD_COUNT; ++i) {
+        if(shields[i].sprite == world->currentShield.sprite)
+            shield = i;
+    }
+    for(int i = 1; i < SHOP_ITEM_COUNT; ++i) {
+        if(shopItems[i].type == 0 && shopItems[i].id == shield + 1 && world->coins >= shopItems[i].cost) {
+            ApplyInput((ReplayEvent){world->gameTick, REPLAY_BUY, i, 0}, 0);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Measures how long a tick takes with a large amount of living enemies
+// The hashes must match no matter how many threads are used
+void RunBenchmark() {
+    int counts[] = {1000, 10000, 100000};
+    int ticks = 100;
+
+    for(int i = 0; i < 3; ++i) {
+        ResetGame();
+        world->enemyLimit = counts[i];
+        ReserveEnemies(counts[i]);
+
+        // Make sure the player survives the whole benchmark
+        world->hearts = 1 << 30;
+
+        double total = 0;
+        for(int tick = 0; tick < ticks; ++tick) {
+            // Replace the enemies that died last tick (not timed)
+            while(world->enemyCount < counts[i])
+                SpawnDefaultEnemy(RandomValue(1, ENEMY_TYPES));
+
+            double start = Now();
+            UpdateGame(TICK_TIME);
+            total += Now() - start;
+        }
+
+        printf("%d enemies, %d threads: %.3f ms/tick (hash %08x)\n", counts[i], threadCount, total * 1000 / ticks, HashGame());
+    }
+}
+
+// The enemy layout used before the enemy store was split into arrays
+typedef struct LegacyEnemy {
+    char id;
+    Vector2 position;
+    Vector2 lastPosition;
+    float rotation;
+    float speed;
+    Rectangle bounds;
+    float timer;
+    int state;
+} LegacyEnemy;
+
+// Moves and collides enemies the way UpdateEnemy used to, returns how many hit something
+int LegacyMoveAndCollide(LegacyEnemy * legacy, int count, float deltaTime) {
+    Rectangle playerRect = {-PLAYER_SIZE, -PLAYER_SIZE, PLAYER_SIZE * 2, PLAYER_SIZE * 2};
+    int hits = 0;
+    for(int i = 0; i < count; ++i) {
+        LegacyEnemy * enemyPtr = &legacy[i];
+        enemyPtr->lastPosition = enemyPtr->position;
+        enemyPtr->position.x += sin(enemyPtr->rotation) * deltaTime * enemyPtr->speed;
+        enemyPtr->position.y += cos(enemyPtr->rotation) * deltaTime * enemyPtr->speed;
+
+        float size = EnemySize(enemyPtr->id, enemyPtr->state);
+        enemyPtr->bounds = (Rectangle){
+            enemyPtr->position.x - size,
+            enemyPtr->position.y - size,
+            size * 2,
+            size * 2
+        };
+
+        if(CheckCollisionRecs(enemyPtr->bounds, playerRect))
+            ++hits;
+
+        // Every shield line was rotated again for every enemy
+        for(int j = 0; j < MAX_COLLISION_LINES; ++j) {
+            if(LineRectCollision(ShieldLine(j), enemyPtr->bounds)) {
+                ++hits;
+                break;
+            }
+        }
+    }
+    return hits;
+}
+
+// Compares the old movement and collision path against the batched kernels
+void RunKernelBenchmark() {
+    int counts[] = {1000, 10000, 100000};
+    int ticks = 100;
+    printf("SIMD width: %d\n", SIMD_WIDTH);
+
+    for(int i = 0; i < 3; ++i) {
+        ResetGame();
+        world->enemyLimit = counts[i];
+        while(world->enemyCount < counts[i])
+            SpawnDefaultEnemy(RandomValue(1, ENEMY_TYPES));
+        UpdateShieldGeometry();
+
+        // Copy the same enemies into the old layout
+        LegacyEnemy * legacy = (LegacyEnemy *)calloc(world->enemyCount, sizeof(LegacyEnemy));
+        for(int j = 0; j < world->enemyCount; ++j) {
+            legacy[j].id = world->enemies.id[j];
+            legacy[j].position = (Vector2){world->enemies.x[j], world->enemies.y[j]};
+            legacy[j].rotation = world->enemies.rotation[j];
+            legacy[j].speed = world->enemies.speed[j];
+            legacy[j].state = world->enemies.state[j];
+        }
+
+        double start = Now();
+        int legacyHits = 0;
+        for(int tick = 0; tick < ticks; ++tick)
+            legacyHits += LegacyMoveAndCollide(legacy, world->enemyCount, TICK_TIME);
+        double legacyTime = (Now() - start) * 1000 / ticks;
+
+        start = Now();
+        int hits = 0;
+        for(int tick = 0; tick < ticks; ++tick) {
+            MoveEnemies(0, world->enemyCount, TICK_TIME);
+            CollideEnemies(0, world->enemyCount);
+            for(int j = 0; j < world->enemyCount; ++j)
+                hits += world->enemies.hits[j] != 0;
+        }
+        double time = (Now() - start) * 1000 / ticks;
+
+        printf("%d enemies: legacy %.3f ms/tick (%d hits), batched %.3f ms/tick (%d hits), %.1fx faster\n",
+            counts[i], legacyTime, legacyHits, time, hits, legacyTime / time);
+        free(legacy);
+    }
+}
+
+// Measures how long it takes to spawn a whole wave in one tick on top of enemies that are already there
+void RunWaveBenchmark() {
+    int counts[] = {100, 1000, 10000};
+    int existing = 10000;
+    int repeats = 20;
+
+    for(int i = 0; i < 3; ++i) {
+        Wave crowd = {existing, {0, 1, 1, 1, 1, 1}, EDGE_ALL, {0}, {0}, 0};
+        Wave burst = {counts[i], {0, 1, 1, 1, 1, 1}, EDGE_LEFT | EDGE_TOP, {0}, {0}, 0};
+        PrepareWave(&crowd);
+        PrepareWave(&burst);
+        world->enemyLimit = existing + counts[i];
+        world->hearts = 1 << 30;
+
+        double spawnTotal = 0;
+        double tickTotal = 0;
+        int spawned = 0;
+        for(int repeat = 0; repeat < repeats; ++repeat) {
+            // Start from the same crowd every time (not timed)
+            ResetGame();
+            SpawnWave(&crowd);
+
+            double start = Now();
+            spawned += SpawnWave(&burst);
+            spawnTotal += Now() - start;
+
+            // The tick after a burst has to handle all of it
+            start = Now();
+            UpdateGame(TICK_TIME);
+            tickTotal += Now() - start;
+        }
+
+        printf("%d enemy wave onto %d enemies: %.3f ms to spawn (%d spawned), %.3f ms for the next tick (hash %08x)\n",
+            counts[i], existing, spawnTotal * 1000 / repeats, spawned / repeats, tickTotal * 1000 / repeats, HashGame());
+    }
+}
 
-        Vector2 position = (Vector2){
-            // Draw items relative to the center of the screen and offset image to be centered
-            center.x + (i - 1 - shopPage * 3) * scale * 11 - (shopItems[i].texture.width * scale / 20) + xOffset,
-            scale * 8
-        };
+// Compares counting every enemy's timer down each tick (the way UpdateEnemy used to) against the timer wheel
+// The timers are as long as the game's (1 to 8 seconds), so most of them are waiting on any given tick
+void RunTimerBenchmark() {
+    int counts[] = {1000, 10000, 100000};
+    int ticks = 10 * TICK_RATE;
 
-        // Check if the mouse is within the shop items bounds
-        if( GetMouseX() > position.x && 
-            GetMouseY() > position.y && 
-            GetMouseX() < position.x + shopItems[i].texture.width * scale / 10 && 
-            GetMouseY() < position.y + shopItems[i].texture.height * scale / 10
-        ) {
-            // Highlight selected item
-            itemColor = WHITE;
+    for(int i = 0; i < 3; ++i) {
+        ResetGame();
+        world->enemyLimit = counts[i];
+        SpawnEnemies(1, 0, counts[i]);
 
-            // Check if player is and can afford buying the item
-            if(IsMouseButtonReleased(0) && coins >= shopItems[i].cost) {
-                coins -= shopItems[i].cost;
-                switch(shopItems[i].type) {
-                    case 0: // Shield
-                        currentShield = shields[shopItems[i].id];
-                        break;
-                    case 1: // Heart
-                        hearts += shopItems[i].id;
-                        break;
+        // Give every enemy the same timer both ways
+        float * polled = (float *)malloc(counts[i] * sizeof(float));
+        for(int j = 0; j < counts[i]; ++j) {
+            int length = RandomValue(TICK_RATE, 8 * TICK_RATE);
+            polled[j] = length * TICK_TIME;
+            ScheduleTimer(j, TIMER_NONE, length);
+        }
+
+        double start = Now();
+        int polledFired = 0;
+        for(int tick = 0; tick < ticks; ++tick) {
+            for(int j = 0; j < counts[i]; ++j) {
+                if(polled[j] > 0) {
+                    polled[j] -= TICK_TIME;
+                    polledFired += polled[j] <= 0;
                 }
             }
         }
+        double polledTime = (Now() - start) * 1000 / ticks;
 
-        // Draw the item
-        DrawTextureEx(
-            shopItems[i].texture,
-            position,
-            0,
-            scale / 10,
-            itemColor
-        );
+        start = Now();
+        int pending = world->pendingTimers;
+        for(int tick = 0; tick < ticks; ++tick)
+            FireTimers();
+        double time = (Now() - start) * 1000 / ticks;
+
+        printf("%d timers: polling %.4f ms/tick (%d fired), wheel %.4f ms/tick (%d fired), %.1fx faster\n",
+            counts[i], polledTime, polledFired, time, pending - world->pendingTimers, polledTime / time);
+        free(polled);
     }
 }
 
-// The render method should contain all rendering code
-void Render(float scale, float deltaTime) {
-    // Clear the screen
-    ClearBackground(WHITE);
+// Compares the spatial grid against checking every pair of enemies, with the enemies spread out evenly (an enemy per two cells)
+// The grid's cost per enemy should stay flat as the count goes up, checking every pair costs more per enemy the more there are
+void RunGridBenchmark() {
+    int counts[] = {1000, 5000, 10000, 50000};
+    int ticks = 20;
+    int samples = 1000;
 
-    // Render all enemies
-    for(int i = 0; i<MAX_ENEMIES;++i) {
-        // Don't render if the enemy is dead (id=0)
-        if(!enemies[i].id)
-            continue;
+    for(int i = 0; i < 4; ++i) {
+        int count = counts[i];
+        ResetGame();
+        world->enemyLimit = count;
+        ReserveEnemies(count);
 
-        // Update the enemy here to save on time
-        if(!shopOpen)
-            UpdateEnemy(&enemies[i], deltaTime, scale);
+        // Half slimes, a quarter small slimes and a quarter blocks, spread over a square
+        SpawnEnemies(1, 0, count / 4);
+        SpawnEnemies(4, 0, count / 2);
+        SpawnEnemies(4, 2, count - count / 4 - count / 2);
+        float half = sqrtf(count * GRID_CELL_SIZE * GRID_CELL_SIZE * 2) / 2;
+        for(int j = 0; j < count; ++j) {
+            world->enemies.x[j] = world->enemies.lastX[j] = RandomValue(-10000, 10000) / 10000.0f * half;
+            world->enemies.y[j] = world->enemies.lastY[j] = RandomValue(-10000, 10000) / 10000.0f * half;
+        }
 
-        // Detirmine the sprites original dimensions
-        Rectangle source = {
-            0,
-            0,
-            (float)enemyTex.width,
-            (float)enemyTex.height
-        };
+        // No time passes, so pushing doesn't move the enemies and every tick does the same work
+        UpdateShieldGeometry();
+        double buildTime = 0;
+        double start = Now();
+        for(int tick = 0; tick < ticks; ++tick) {
+            double buildStart = Now();
+            BuildGrid(1);
+            buildTime += Now() - buildStart;
+            memset(world->enemies.hits, 0, count);
+            InteractEnemies(0, 0);
+        }
+        double gridTime = (Now() - start) * 1e9 / ticks / count;
+        buildTime = buildTime * 1e9 / ticks / count;
 
-        // Flip the sprite if looking left
-        if(sin(enemies[i].rotation) < 0) {
-            source = (Rectangle){
-                enemyTex.width * 2.0f,
-                0,
-                (float)-enemyTex.width,
-                (float)enemyTex.height
-            };
+        // Check a sample of enemies against every other enemy, doing the same work as InteractEnemies
+        int sample = samples < count ? samples : count;
+        int matches = 0;
+        int hits = 0;
+        volatile float pushed = 0;
+        start = Now();
+        for(int j = 0; j < sample; ++j) {
+            unsigned char flags = GridFlags(j);
+            float x = world->enemies.x[j];
+            float y = world->enemies.y[j];
+            float size = world->enemies.size[j];
+            bool hit = false;
+            Vector2 push = {0, 0};
+            for(int k = 0; k < count; ++k) {
+                unsigned char otherFlags = GridFlags(k);
+                float dx = x - world->enemies.x[k];
+                float dy = y - world->enemies.y[k];
+                float reach = size + world->enemies.size[k];
+                if(((flags & GRID_FRAGMENT) && (otherFlags & GRID_HITTABLE)) || ((flags & GRID_HITTABLE) && (otherFlags & GRID_FRAGMENT)))
+                    hit |= fabsf(dx) < reach && fabsf(dy) < reach;
+
+                float distanceSqr = dx * dx + dy * dy;
+                if(k != j && (flags & otherFlags & GRID_PUSHES) && distanceSqr > 0 && distanceSqr < reach * reach) {
+                    float distance = sqrtf(distanceSqr);
+                    push.x += dx / distance * (reach - distance);
+                    push.y += dy / distance * (reach - distance);
+                }
+            }
+            pushed += push.x + push.y;
+            hits += hit;
+            matches += hit == ((world->enemies.hits[j] & HIT_FRAGMENT) != 0);
         }
+        double pairTime = (Now() - start) * 1e9 / sample;
 
-        // Render the enemy
-        DrawTexturePro(
-            enemyTex, 
-            source,
-            enemies[i].bounds,
-            (Vector2){0, 0},
-            0,
-            ColorFromVec3(
-                enemyColors[enemies[i].id - 1], 
-                enemies[i].state == 1 ? (0.5f - enemies[i].timer) * 510 : 255 // Fade out a dead enemy
-            )
-        );
+        // Find the enemies around the shield (only measured, CollideEnemies checks every enemy against the shield instead)
+        int shieldRounds = 1000;
+        float outer = world->shieldOuter;
+        int * found = (int *)malloc(count * sizeof(int));
+        int gridFound = 0;
+        start = Now();
+        for(int round = 0; round < shieldRounds; ++round)
+            gridFound = QueryGrid(-outer, -outer, outer, outer, 0, found, count);
+        double gridShield = (Now() - start) * 1e6 / shieldRounds;
+
+        int scanFound = 0;
+        start = Now();
+        for(int round = 0; round < shieldRounds; ++round) {
+            scanFound = 0;
+            for(int j = 0; j < count; ++j) {
+                float size = world->enemies.size[j];
+                if(fabsf(world->enemies.x[j]) < outer + size && fabsf(world->enemies.y[j]) < outer + size)
+                    found[scanFound++] = j;
+            }
+        }
+        double scanShield = (Now() - start) * 1e6 / shieldRounds;
+        free(found);
 
-        // Draw debug lines
-        if(DEBUG)
-            DrawRectangleLinesEx(enemies[i].bounds, 1, RED);
+        printf("%d enemies: grid %.1f ns/enemy (%.1f building), every pair %.1f ns/enemy, %d/%d hits match (%d hit); shield area: grid %.2f us (%d found), scan %.2f us (%d found)\n",
+            count, gridTime, buildTime, pairTime, matches, sample, hits, gridShield, gridFound, scanShield, scanFound);
     }
-    
-    // Draw the player
-    unsigned char playerAlpha = 255;
-    if(died)
-        playerAlpha = deathTimer < 0.5f ? (0.5f - deathTimer) * 510 : 0;
-    
-    DrawTexturePro(
-        playerTex[sprite], 
-        (Rectangle){
-            0,
-            0,
-            (float)playerTex[sprite].width,
-            (float)playerTex[sprite].height
-        },
-        playerRect,
-        (Vector2){0, 0},
-        0,
-        (Color){
-            255,
-            255,
-            255,
-            playerAlpha
+}
+
+// Times the simulation math against libm and checks how far it strays, returns false if any of it is too inaccurate
+bool RunMathBenchmark() {
+    int count = 1 << 16;
+    int rounds = 256;
+    float * angles = (float *)malloc(count * sizeof(float));
+    Vector2 * points = (Vector2 *)malloc(count * sizeof(Vector2));
+    for(int i = 0; i < count; ++i) {
+        // Angles cover a few turns either way (spinning enemies wind up past a single turn)
+        angles[i] = (RandomValue(0, 1 << 20) / (float)(1 << 20) - 0.5f) * 16 * PI;
+        points[i] = (Vector2){RandomValue(-5000, 5000) / 100.0f, RandomValue(-5000, 5000) / 100.0f};
+    }
+
+    // Worst errors against the exact values (libm in double), the bounds in the comments of the functions are checked at the end
+    double sinErrors[3] = {0, 0, 0};
+    double atanErrors[3] = {0, 0, 0};
+    for(int i = 0; i < count; ++i) {
+        float results[3][2];
+        results[0][0] = sinf(angles[i]);
+        results[0][1] = cosf(angles[i]);
+        FastSinCos(angles[i], &results[1][0], &results[1][1]);
+        TableSinCos(angles[i], &results[2][0], &results[2][1]);
+        float atans[3] = {atan2f(points[i].y, points[i].x), FastAtan2(points[i].y, points[i].x), TableAtan2(points[i].y, points[i].x)};
+        for(int j = 0; j < 3; ++j) {
+            sinErrors[j] = fmax(sinErrors[j], fmax(fabs(results[j][0] - sin((double)angles[i])), fabs(results[j][1] - cos((double)angles[i]))));
+
+            // -π and π are the same angle
+            atanErrors[j] = fmax(atanErrors[j], fabs(remainder(atans[j] - atan2((double)points[i].y, (double)points[i].x), 2 * 3.14159265358979323846)));
         }
-    );
+    }
 
-    // Draw the players shield
-    DrawTexturePro(
-        currentShield.texture,
-        (Rectangle){
-            0,
-            0,
-            (float)currentShield.texture.width,
-            (float)currentShield.texture.height
-        },
-        (Rectangle) {
-            center.x,
-            center.y,
-            scale * 8,
-            scale * 4
-        },
-        (Vector2){
-            scale * 4, scale * 2
-        },
-        rotation - 90,
-        (Color){
-            255,
-            255,
-            255,
-            playerAlpha
+    // The results are summed so the loops can't be thrown away
+    volatile float sink = 0;
+    double times[3][3];
+    for(int j = 0; j < 3; ++j) {
+        double start = Now();
+        float sum = 0;
+        for(int round = 0; round < rounds; ++round) {
+            for(int i = 0; i < count; ++i) {
+                float sine, cosine;
+                if(j == 0) {
+                    sine = sinf(angles[i]);
+                    cosine = cosf(angles[i]);
+                }
+                else if(j == 1)
+                    FastSinCos(angles[i], &sine, &cosine);
+                else
+                    TableSinCos(angles[i], &sine, &cosine);
+                sum += sine + cosine;
+            }
         }
-    );
-    
-    // Draw debug lines
-    if(DEBUG)
-        DrawRectangleLinesEx(playerRect, 1, GREEN);
+        times[0][j] = (Now() - start) * 1e9 / ((double)count * rounds);
 
+        start = Now();
+        for(int round = 0; round < rounds; ++round) {
+            for(int i = 0; i < count; ++i) {
+                float y = points[i].y;
+                float x = points[i].x;
+                sum += j == 0 ? atan2f(y, x) : j == 1 ? FastAtan2(y, x) : TableAtan2(y, x);
+            }
+        }
+        times[1][j] = (Now() - start) * 1e9 / ((double)count * rounds);
+        sink += sum;
+    }
 
-    // Draw UI
-    char str[255]; // Temp string for converting int to string
-    sprintf(str, "%d", score);
-    DrawText(str, scale / 2, scale / 2, scale * 2, BLACK);
+    // Close call checks, with and without the square root
+    Vector2 center = {0, 0};
+    for(int j = 0; j < 2; ++j) {
+        double start = Now();
+        int close = 0;
+        for(int round = 0; round < rounds; ++round) {
+            for(int i = 0; i < count; ++i)
+                close += j == 0 ? Distance(center, points[i]) < 2.5f : DistanceSquared(center, points[i]) < 2.5f * 2.5f;
+        }
+        times[2][j] = (Now() - start) * 1e9 / ((double)count * rounds);
+        sink += close;
+    }
 
-    // Underline score with the next enemy color
-    DrawRectangle(
-        scale / 2, 
-        scale * 2.2, 
-        MeasureText(str, scale * 2), 
-        scale / 4, 
-        ColorFromVec3(enemyColors[enemyLevel], 255)
-    );
+    printf("sin+cos: libm %.2f ns (error %.1e), fast %.2f ns (error %.1e), table %.2f ns (error %.1e)\n",
+        times[0][0], sinErrors[0], times[0][1], sinErrors[1], times[0][2], sinErrors[2]);
+    printf("atan2: libm %.2f ns (error %.1e), fast %.2f ns (error %.1e), table %.2f ns (error %.1e)\n",
+        times[1][0], atanErrors[0], times[1][1], atanErrors[1], times[1][2], atanErrors[2]);
+    printf("distance check: sqrt %.2f ns, squared %.2f ns\n", times[2][0], times[2][1]);
+    free(angles);
+    free(points);
 
-    // Draw money
-    sprintf(str, "%d", coins);
-    DrawText(str, windowSize.x - (TextLength(str) + 3) * scale, scale / 2, scale * 2, BLACK);
-    DrawTextureEx(coin, (Vector2){windowSize.x - scale * 2.5f, scale / 1.9f}, 0, scale / 5, WHITE);
-
-    // Draw bonus
-    if(bonusTime < 2) {
-        // Convert the bonus' reward to as string
-        sprintf(str, "%d", latestBonus.reward);
-
-        // Concatenate all the strings together
-        const char * tokens[] = {
-            "+", str, " ", latestBonus.name
-        };
-        const char * bonusStr = TextJoin(tokens, 4, "");
-
-        // Draw the final string
-        DrawText(
-            bonusStr, 
-            windowSize.x - TextLength(bonusStr) * scale / 1.8, 
-            scale * 2.5, scale, 
-            (Color){200, 200, 200, (unsigned char)(255 - 120 * bonusTime)}
-        );
+    // Each function has to stay within the bound its comment gives (the game can't tell the difference below a few millionths of a radian anyway)
+    double sinLimits[3] = {0, 1e-7, 2e-6};
+    double atanLimits[3] = {0, 3e-7, 4e-7};
+    bool passed = true;
+    for(int j = 1; j < 3; ++j) {
+        if(sinErrors[j] > sinLimits[j] || atanErrors[j] > atanLimits[j]) {
+            printf("%s math is too inaccurate\n", j == 1 ? "Fast" : "Table");
+            passed = false;
+        }
     }
+    return passed;
+}
 
-    // Draw hearts
-    int remaining = hearts; // The remaining unrendered hearts
-    for(int i = 0; i < hearts; ++i) {
-        if(scale / 2 + scale * i * 2 > center.x) {
-            remaining -= i;
-            break;
+// Measures how long a sampled rotation takes to reach the shield, with the simulation between frames and on its own thread
+// Frames take 4 ms with every 10th one stalling in the present (like a vsync miss or driver stall), inputs are sampled once a frame
+void RunLatencyBenchmark(float stall) {
+    for(int threaded = 0; threaded < 2; ++threaded) {
+        ResetGame();
+        world->hearts = 1 << 30;
+        latencyCount = 0;
+        latencyPending = 0;
+        if(threaded && !StartSimulation()) {
+            printf("Failed to start the simulation thread\n");
+            return;
         }
 
-        DrawTextureEx(
-            heart,
-            (Vector2){scale / 2 + scale * i * 2, windowSize.y - scale * 2},
-            0,
-            scale / 10,
-            WHITE
-        );
+        float scale = 1;
+        float tickAccumulator = 0;
+        int frames = 0;
+        double start = Now();
+        double frameStart = start;
+        while(frameStart - start < 5) {
+            double now = Now();
+            float deltaTime = now - frameStart < MAX_FRAME_TIME ? now - frameStart : MAX_FRAME_TIME;
+            frameStart = now;
+            if(threaded)
+                AcquireSnapshot();
+
+            // The mouse moves every frame
+            SendInput((ReplayEvent){world->gameTick, REPLAY_ROTATE, frames % 360, 0}, scale);
+            if(!threaded) {
+                tickAccumulator += deltaTime;
+                while(tickAccumulator >= TICK_TIME) {
+                    SimulateTick(&scale);
+                    tickAccumulator -= TICK_TIME;
+                }
+            }
+
+            // Drawing and presenting
+            SleepSeconds(++frames % 10 == 0 ? stall / 1000 : 0.004);
+        }
+        StopSimulation();
+
+        PrintLatency(threaded ? "Simulation thread" : "Single thread");
     }
+}
 
-    // Draw text for the remaining hearts
-    if(remaining != hearts) {
-        sprintf(str, "%d", remaining);
-        
-        // Concatenate the strings together
-        const char * tokens[] = {
-            "+", str
-        };
-        DrawText(TextJoin(tokens, 2, ""), center.x + scale * 1.3, windowSize.y - scale * 1.7, scale * 1.2, BLACK);
+// Plays back a recording without a window as fast as possible
+void RunReplay(const char * fileName, const char * traceName) {
+    Vector2 size;
+    if(!StartReplay(fileName, &size)) {
+        printf("Failed to read %s\n", fileName);
+        return;
     }
+    float scale = ResizeGame(size.x, size.y);
 
-    // If shop is open or still in animation then render it
-    if(shopTimer > 0)
-        DrawShop(scale, deltaTime);
+    // Nothing is shown while replaying, so the trace can hold up the replay instead of dropping events
+    traceWait = true;
+    if(traceName && !StartTrace(traceName))
+        printf("Failed to trace to %s\n", traceName);
 
-    // Draw the death message if player is dead
-    if(died) {
-        Color textColor = BLACK;
-        textColor.a = (unsigned char)(255 - playerAlpha);
+    double start = Now();
+    while(ReplayInputs(&scale))
+        UpdateGame(TICK_TIME);
+    double time = Now() - start;
+    StopTrace();
 
-        DrawText(
-            "You died", 
-            center.x - TextLength("You died") * scale, 
-            center.y - scale * 4, 
-            scale * 4, 
-            textColor
-        );
+    printf(
+        "Replayed %.1f s of game in %.3f s (%.0fx real time, %.4f ms/tick, %d threads)\n",
+        (double)world->gameTick / TICK_RATE,
+        time,
+        world->gameTick / (double)TICK_RATE / time,
+        time * 1000 / (world->gameTick ? world->gameTick : 1),
+        threadCount
+    );
+}
 
-        // Make subtext more faded
-        textColor.a /= 2;
-        DrawText(
-            "Press any key to continue", 
-            center.x - TextLength("Press any key to continue") * scale / 4, 
-            center.y, 
-            scale, 
-            textColor
-        );
+// The outcome of one game played by the autoplayer
+typedef struct GameResult {
+    float survival;                 // Seconds until the player ran out of hearts
+    bool survived;                  // If the game hit the time limit instead
+    int score;
+    int coinsEarned;
+    int purchases;
+    float levelTimes[ENEMY_TYPES];  // When each enemy level was reached (-1 if never)
+} GameResult;
+
+// Batch variables (shared by the batch threads)
+pthread_mutex_t batchLock = PTHREAD_MUTEX_INITIALIZER;
+World batchSettings;        // Every batch game starts as a copy of this world
+int batchGames = 0;         // How many games to play
+int batchNext = 0;          // The next game that hasn't been started
+long batchTicks = 0;        // The longest a game can last
+GameResult * batchResults;  // The outcome of every game
+
+// Plays one game until the player runs out of hearts (or the time limit)
+void PlayBatchGame(unsigned int seed, GameResult * result) {
+    World game = batchSettings;
+    world = &game;
+    SeedRandom(seed);
+    ResizeGame(800, 500);
+
+    memset(result, 0, sizeof(GameResult));
+    for(int i = 1; i < ENEMY_TYPES; ++i)
+        result->levelTimes[i] = -1;
+
+    int spent = 0;
+    int level = 0;
+    while(!world->died && world->gameTick < batchTicks) {
+        int coins = world->coins;
+        result->purchases += Autoplay();
+        spent += coins - world->coins;
+
+        UpdateGame(TICK_TIME);
+
+        // Remember when each level is reached
+        for(; level < world->enemyLevel; ++level)
+            result->levelTimes[level + 1] = (float)world->gameTick / TICK_RATE;
     }
+
+    result->survival = (float)world->gameTick / TICK_RATE;
+    result->survived = !world->died;
+    result->score = world->score;
+    result->coinsEarned = world->coins + spent;
+
+    FreeWorld(&game);
+    world = &mainWorld;
 }
 
-// HandleInput contains all of the core user input processing code
-void HandleInput(float deltaTime) {
-    // Rotate player to look at the mouse
-    if(GetMouseX() >= 0 && GetMouseX() <= windowSize.x && GetMouseY() >= 0 && GetMouseY() <= windowSize.y)
-        rotation = 180 - round((atan2(GetMousePosition().x - center.x, GetMousePosition().y - center.y) / 3.1415)*180);
+// Batch thread entrypoint, plays games until there are none left
+void * BatchWorker(void * argument) {
+    // The main thread helps too, batch games aren't profiled
+    profiling = false;
+    while(true) {
+        pthread_mutex_lock(&batchLock);
+        int game = batchNext++;
+        pthread_mutex_unlock(&batchLock);
+        if(game >= batchGames)
+            break;
 
-    // Space opens/closes the shop
-    if(IsKeyPressed(KEY_SPACE))
-        shopOpen = !shopOpen;
+        PlayBatchGame(game + 1, &batchResults[game]);
+    }
+    return NULL;
 }
 
-// Main method entrypoint
-int main() {
-    // The time of the last frame
-    float oldTime;
+// Prints the mean and percentiles of some values (the values are sorted)
+void PrintStats(const char * name, float * values, int count) {
+    double sum = 0;
+    for(int i = 0; i < count; ++i)
+        sum += values[i];
 
-    // How many seconds until another enemy should spawn
-    float spawnTime = 2;
+    qsort(values, count, sizeof(float), CompareFloats);
+    printf(
+        "%-14s mean %9.1f   p10 %9.1f   p50 %9.1f   p90 %9.1f   max %9.1f\n",
+        name,
+        sum / count,
+        values[count / 10],
+        values[count / 2],
+        values[count * 9 / 10],
+        values[count - 1]
+    );
+}
 
-    // Set the starting window size
-    windowSize = (Vector2){800, 500};
+// Reads a comma separated list of numbers, returns how many were read
+int ReadNumbers(const char * text, float * numbers, int count) {
+    int read = 0;
+    char * end;
+    while(read < count) {
+        numbers[read++] = strtof(text, &end);
+        if(*end != ',')
+            break;
+        text = end + 1;
+    }
+    return read;
+}
 
-    // Init the window
-    SetConfigFlags(FLAG_WINDOW_RESIZABLE);
-    InitWindow(windowSize.x, windowSize.y, "Block-Cycle");
+// Plays lots of games with the autoplayer on every core and prints balance statistics
+// Options: games=N minutes=N threads=N reaction=SECONDS levels=A,B,C,D,E waves=A,B,C,D,E spawn=START,RAMP,MIN
+int RunBatch(int argc, char ** argv) {
+    InitWorld(&batchSettings);
+    batchGames = 10000;
+    float minutes = 10;
+    int threads = 0;
+    float reaction = 0.5f;
 
-    // Init all the shields
-    shields[0] = (Shield){ // Basic shield
-        // Texture
-        LoadTexture("resources/images/shield/basic.png"),
-        // Collision lines
-        {
-            (Line){{2.5, -1.6}, {2.5, 1.6}}
+    for(int i = 0; i < argc; ++i) {
+        const char * value = strchr(argv[i], '=');
+        if(value == NULL) {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
         }
-    };
-    shields[1] = (Shield){ // Long shield
-        // Texture
-        LoadTexture("resources/images/shield/long.png"),
-        // Collision lines
-        {
-            (Line){{2.5, -2.2}, {2.5, 2.2}}
+        ++value;
+
+        if(strncmp(argv[i], "games=", 6) == 0)
+            batchGames = atoi(value);
+        else if(strncmp(argv[i], "minutes=", 8) == 0)
+            minutes = atof(value);
+        else if(strncmp(argv[i], "threads=", 8) == 0)
+            threads = atoi(value);
+        else if(strncmp(argv[i], "reaction=", 9) == 0)
+            reaction = atof(value);
+        else if(strncmp(argv[i], "levels=", 7) == 0) {
+            float levels[ENEMY_TYPES];
+            int count = ReadNumbers(value, levels, ENEMY_TYPES);
+            for(int j = 0; j < count; ++j)
+                batchSettings.levelScores[j] = (int)levels[j];
         }
-    };
-    shields[2] = (Shield){ // Armor shield
-        // Texture
-        LoadTexture("resources/images/shield/armor.png"),
-        // Collision lines
-        {
-            (Line){{-1.4,  1.8}, {1.4, 1.8}},
-            (Line){{-1.4, -1.8}, {1.4, -1.8}}
+        else if(strncmp(argv[i], "waves=", 6) == 0) {
+            float waves[ENEMY_TYPES];
+            int count = ReadNumbers(value, waves, ENEMY_TYPES);
+            for(int j = 0; j < count; ++j)
+                batchSettings.waves[j].count = (int)waves[j];
         }
-    };
-    shields[3] = (Shield){ // Boomerang shield
-        // Texture
-        LoadTexture("resources/images/shield/boomarang.png"),
-        // Collision lines
-        {
-            (Line){{1.2,  1.8}, {2.9, 0}},
-            (Line){{1.2, -1.8}, {2.9, 0}}
+        else if(strncmp(argv[i], "spawn=", 6) == 0) {
+            float spawn[3] = {batchSettings.spawnStart, batchSettings.spawnRamp, batchSettings.spawnMin};
+            ReadNumbers(value, spawn, 3);
+            batchSettings.spawnStart = spawn[0];
+            batchSettings.spawnRamp = spawn[1];
+            batchSettings.spawnMin = spawn[2];
         }
-    };
-
-    // Set the default shield
-    currentShield = shields[0];
+        else {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if(batchGames <= 0)
+        return 0;
 
-    // Load all the player textures
-    playerTex[0] = LoadTexture("resources/images/up.png");
-    playerTex[1] = LoadTexture("resources/images/right.png");
-    playerTex[2] = LoadTexture("resources/images/down.png");
-    playerTex[3] = LoadTexture("resources/images/left.png");
+    batchTicks = (long)(minutes * 60 * TICK_RATE);
+    autoplayReaction = reaction * TICK_RATE > 1 ? (int)(reaction * TICK_RATE) : 1;
+    if(threads <= 0)
+        threads = CoreCount();
+    batchResults = (GameResult *)malloc(batchGames * sizeof(GameResult));
+    pthread_t * batchThreads = (pthread_t *)malloc(threads * sizeof(pthread_t));
 
-    // Load al the enemy textures
-    enemyTex = LoadTexture("resources/images/enemies/enemy.png");
-    
-    // Load other textures
-    coin = LoadTexture("resources/images/coin.png");
-    arrow = LoadTexture("resources/images/arrow.png");
-    heart = LoadTexture("resources/images/heart.png");
+    // Play every game (the main thread helps too)
+    double start = Now();
+    int started = 1;
+    for(; started < threads; ++started) {
+        if(pthread_create(&batchThreads[started], NULL, BatchWorker, NULL) != 0)
+            break;
+    }
+    BatchWorker(NULL);
+    for(int i = 1; i < started; ++i)
+        pthread_join(batchThreads[i], NULL);
+    double time = Now() - start;
 
-    // Load shop items
-    shopItems[0] = (ShopItem){
-        LoadTexture("resources/images/shop/heart.png"),
-        10,
-        1,
-        1
-    };
-    shopItems[1] = (ShopItem){
-        LoadTexture("resources/images/shop/long_shield.png"),
-        10,
-        0,
-        1
-    };
-    shopItems[2] = (ShopItem){
-        LoadTexture("resources/images/shop/armor_shield.png"),
-        40,
-        0,
-        2
-    };
-    shopItems[3] = (ShopItem){
-        LoadTexture("resources/images/shop/boomerang_shield.png"),
-        60,
-        0,
-        3
-    };
+    // Gather the results
+    float * survival = (float *)malloc(batchGames * sizeof(float));
+    float * scores = (float *)malloc(batchGames * sizeof(float));
+    float * coinRates = (float *)malloc(batchGames * sizeof(float));
+    float * purchases = (float *)malloc(batchGames * sizeof(float));
+    float * levelTimes = (float *)malloc(batchGames * sizeof(float));
+    int survivors = 0;
+    for(int i = 0; i < batchGames; ++i) {
+        survival[i] = batchResults[i].survival;
+        scores[i] = batchResults[i].score;
+        coinRates[i] = batchResults[i].survival > 0 ? batchResults[i].coinsEarned * 60 / batchResults[i].survival : 0;
+        purchases[i] = batchResults[i].purchases;
+        survivors += batchResults[i].survived;
+    }
 
-    // Get initial window size
-    windowSize.x = GetRenderWidth();
-    windowSize.y = GetRenderHeight();
+    printf(
+        "Played %d games in %.2f s (%.0f games/minute, %d threads)\n",
+        batchGames,
+        time,
+        batchGames * 60 / time,
+        started
+    );
+    printf(
+        "Reaction %.2f s, levels at %d,%d,%d,%d,%d, waves of %d,%d,%d,%d,%d every max(%g - score / %g, %g) s, %g minute limit\n",
+        autoplayReaction / (float)TICK_RATE,
+        batchSettings.levelScores[0],
+        batchSettings.levelScores[1],
+        batchSettings.levelScores[2],
+        batchSettings.levelScores[3],
+        batchSettings.levelScores[4],
+        batchSettings.waves[0].count,
+        batchSettings.waves[1].count,
+        batchSettings.waves[2].count,
+        batchSettings.waves[3].count,
+        batchSettings.waves[4].count,
+        batchSettings.spawnStart,
+        batchSettings.spawnRamp,
+        batchSettings.spawnMin,
+        minutes
+    );
+    PrintStats("Survival (s)", survival, batchGames);
+    PrintStats("Score", scores, batchGames);
+    PrintStats("Coins/minute", coinRates, batchGames);
+    PrintStats("Purchases", purchases, batchGames);
+    printf("%.1f%% of games hit the time limit\n", survivors * 100.0f / batchGames);
 
-    // Get initial window center
-    center.x = windowSize.x / 2;
-    center.y = windowSize.y / 2;
+    // How quickly each enemy level shows up
+    for(int level = 1; level < ENEMY_TYPES; ++level) {
+        int reached = 0;
+        for(int i = 0; i < batchGames; ++i) {
+            if(batchResults[i].levelTimes[level] >= 0)
+                levelTimes[reached++] = batchResults[i].levelTimes[level];
+        }
 
-    // Scale of objects on the window
-    float scale = sqrt(pow(windowSize.x, 2) + pow(windowSize.y, 2)) / 50;
+        printf("Level %d (score %d) reached in %.1f%% of games", level + 1, batchSettings.levelScores[level], reached * 100.0f / batchGames);
+        if(reached > 0) {
+            qsort(levelTimes, reached, sizeof(float), CompareFloats);
+            printf(", median %.1f s in", levelTimes[reached / 2]);
+        }
+        printf("\n");
+    }
 
-    // Time inbetween frames
-    float deltaTime;
+    free(survival);
+    free(scores);
+    free(coinRates);
+    free(purchases);
+    free(levelTimes);
+    free(batchThreads);
+    free(batchResults);
+    return 0;
+}
 
-    // Main loop
-    while(!WindowShouldClose()) {
-        // Update window metrics if window resized
-        if(IsWindowResized()) {
-            // Update window size
-            windowSize.x = GetRenderWidth();
-            windowSize.y = GetRenderHeight();
-
-            // Get the window center
-            center.x = windowSize.x / 2;
-            center.y = windowSize.y / 2;
-
-            // Move enemies to their new relative position to avoid teleporting
-            for(int i = 0; i < MAX_ENEMIES; ++i) {
-                enemies[i].position.x /= scale;
-                enemies[i].position.y /= scale;
-            }
+// Checks if an argument is a number
+bool IsNumber(const char * text) {
+    char * end;
+    strtod(text, &end);
+    return end != text && *end == '\0';
+}
 
-            // Update scale
-            scale = sqrt(pow(windowSize.x, 2) + pow(windowSize.y, 2)) / 50;
+// Checks the headless arguments against the usage (options of --batch are checked by RunBatch)
+// Returns false if an option is unknown, an operand is missing or a number isn't one
+bool CheckArguments(int argc, char ** argv) {
+    if(argc < 2)
+        return true;
 
-            // Move enemies to the new position on the window
-            for(int i = 0; i < MAX_ENEMIES; ++i) {
-                enemies[i].position.x *= scale;
-                enemies[i].position.y *= scale;
-            }
+    // Every number has to be one, file names can be anything
+    const char * mode = argv[1];
+    if(strncmp(mode, "--", 2) != 0) {
+        for(int i = 1; i < argc && i < 5; ++i) {
+            if(!IsNumber(argv[i]))
+                return false;
         }
+        return argc <= 6;
+    }
+    if(strcmp(mode, "--batch") == 0)
+        return true;
+    if(strcmp(mode, "--replay") == 0)
+        return argc >= 3 && argc <= 5 && (argc < 4 || IsNumber(argv[3]));
+    if(strcmp(mode, "--bench") == 0 || strcmp(mode, "--bench-latency") == 0)
+        return argc <= 3 && (argc < 3 || IsNumber(argv[2]));
 
-        // Update delta time
-        deltaTime = GetFrameTime();
+    const char * benches[] = {"--bench-kernels", "--bench-waves", "--bench-timers", "--bench-math", "--bench-grid"};
+    for(int i = 0; i < (int)(sizeof(benches) / sizeof(benches[0])); ++i) {
+        if(strcmp(mode, benches[i]) == 0)
+            return argc == 2;
+    }
+    return false;
+}
 
-        // Update the spawn time based on score
-        spawnTime = 3 - score / 100.0f;
+// Headless entrypoint, simulates the game without a window
+// Usage: block_cycle_headless [seed] [ticks] [max enemies] [threads] [record file]
+//        block_cycle_headless --bench [threads] | --bench-kernels | --bench-waves | --bench-timers | --bench-latency [stall ms] | --bench-math | --bench-grid
+//        block_cycle_headless --replay <file> [threads] [trace file]
+//        block_cycle_headless --batch [games=N] [minutes=N] [threads=N] [reaction=S] [levels=A,B,C,D,E] [waves=A,B,C,D,E] [spawn=START,RAMP,MIN]
+int main(int argc, char ** argv) {
+    // Anything that doesn't match the usage gets the usage instead of being guessed at
+    if(!CheckArguments(argc, argv)) {
+        printf(
+            "Usage: %s [seed] [ticks] [max enemies] [threads] [record file]\n"
+            "       %s --bench [threads] | --bench-kernels | --bench-waves | --bench-timers | --bench-latency [stall ms] | --bench-math | --bench-grid\n"
+            "       %s --replay <file> [threads] [trace file]\n"
+            "       %s --batch [games=N] [minutes=N] [threads=N] [reaction=S] [levels=A,B,C,D,E] [waves=A,B,C,D,E] [spawn=START,RAMP,MIN]\n",
+            argv[0], argv[0], argv[0], argv[0]);
+        return 2;
+    }
 
-        // Don't lets enemies spawn faster than every half second
-        if(spawnTime <= 0.5f)
-            spawnTime = 0.5f;
+    const char * bench = argc > 1 && strncmp(argv[1], "--bench", 7) == 0 ? argv[1] : NULL;
+    const char * replay = argc > 2 && strcmp(argv[1], "--replay") == 0 ? argv[2] : NULL;
+    unsigned int seed = argc > 1 && !bench ? (unsigned int)strtoul(argv[1], NULL, 10) : 1;
 
-        // Update the timers
-        if(shopOpen)
-            shopTimer += deltaTime;
-        else {
-            if(shopTimer > 0.2)
-                shopTimer = 0.2;
-            else if(shopTimer > 0)
-                shopTimer -= deltaTime;
-            
-            // Only update timers if unpaused
-            killTimer += deltaTime;
-            bonusTime += deltaTime;
-        }
-
-        // Death specific actions
-        if(!died) {
-            // Check if the time has elapsed the next spawn interval (and if not in shop)
-            if(oldTime / spawnTime < round(oldTime / spawnTime) && GetTime() / spawnTime >= round(oldTime / spawnTime) && !shopOpen)
-                SpawnDefaultEnemy(GetRandomValue(1, enemyLevel + 1));
-            oldTime = GetTime();
-            
-            // Update all input
-            HandleInput(deltaTime);
-        }
-        else if(!shopOpen)
-            deathTimer += deltaTime;
-        else if(IsKeyPressed(KEY_SPACE)) // Allow user to close shop if dead
-            shopOpen = false;
+    // The main thread is profiled and traced
+    profiling = true;
+    tracing = true;
 
-        // Get the players sprite index
-        sprite = (int)round(rotation / 90) % 4;
+    // Init the shields, shop and the world that is played
+    InitGame();
 
-        // Wait for a keypress before resetting from death
-        if(died && GetKeyPressed()) {
-            died = false;
-            SetScore(0);
-            deathTimer = 0;
-            hearts = 1;
-
-            // Remove all enemies
-            for(int i = 0; i<MAX_ENEMIES; ++i)
-                enemies[i].id = 0;
-        }
-
-        // Update the players bounding rectangle
-        playerRect = (Rectangle){
-            center.x - scale,
-            center.y - scale,
-            scale * 2,
-            scale * 2
-        };
+    // Balance runs simulate lots of their own worlds
+    if(argc > 1 && strcmp(argv[1], "--batch") == 0)
+        return RunBatch(argc - 2, argv + 2);
 
-        // Draw everything
-        BeginDrawing();
-        Render(scale, deltaTime);
-        EndDrawing();
+    long ticks = argc > 2 && !bench ? strtol(argv[2], NULL, 10) : TICK_RATE * 60;
+    if(argc > 3 && !replay)
+        world->enemyLimit = atoi(argv[3]);
+    SeedRandom(seed);
+
+    // Start the worker threads (every core by default)
+    int threads = 0;
+    if(bench)
+        threads = argc > 2 && strcmp(bench, "--bench-latency") != 0 ? atoi(argv[2]) : 0;
+    else if(replay)
+        threads = argc > 3 ? atoi(argv[3]) : 0;
+    else if(argc > 4)
+        threads = atoi(argv[4]);
+    InitWorkers(threads);
+
+    // Simulate a window of the default size
+    ResizeGame(800, 500);
+
+    // Play back a recording as fast as possible
+    if(replay) {
+        RunReplay(replay, argc > 4 ? argv[4] : NULL);
+        CloseWorkers();
+        FreeWorld(world);
+        return 0;
     }
 
-    // Unload everything and close the window
-    for(int i = 0; i < 4; ++i)
-        UnloadTexture(playerTex[i]);
-    for(int i = 0; i < SHIELD_COUNT; ++i)
-        UnloadTexture(shields[i].texture);
-    for(int i = 0; i < SHOP_ITEM_COUNT; ++i)
-        UnloadTexture(shopItems[i].texture);
-    UnloadTexture(enemyTex);
-    
-    CloseWindow();
-}
\ No newline at end of file
+    // Record the session if asked to
+    // Headless recordings also save the hash of every tick, so playing them back on another build finds the first tick that differs
+    recordChecks = true;
+    if(argc > 5 && !bench && !StartRecording(argv[5], seed))
+        printf("Failed to record to %s\n", argv[5]);
+
+    if(bench) {
+        // The math benchmark also checks accuracy, so it fails like a test would
+        int failed = 0;
+        if(strcmp(bench, "--bench-kernels") == 0)
+            RunKernelBenchmark();
+        else if(strcmp(bench, "--bench-waves") == 0)
+            RunWaveBenchmark();
+        else if(strcmp(bench, "--bench-timers") == 0)
+            RunTimerBenchmark();
+        else if(strcmp(bench, "--bench-latency") == 0)
+            RunLatencyBenchmark(argc > 2 ? atof(argv[2]) : 50);
+        else if(strcmp(bench, "--bench-grid") == 0)
+            RunGridBenchmark();
+        else if(strcmp(bench, "--bench-math") == 0)
+            failed = !RunMathBenchmark();
+        else
+            RunBenchmark();
+        CloseWorkers();
+        FreeWorld(world);
+        return failed;
+    }
+
+    // Game statistics
+    int deaths = 0;
+    int bestScore = 0;
+    int purchases = 0;
+
+    for(long tick = 0; tick < ticks; ++tick) {
+        // Start a new game once the death animation is over
+        if(world->died && world->deathTimer > 0.5f) {
+            ++deaths;
+            ApplyInput((ReplayEvent){world->gameTick, REPLAY_RESET, 0, 0}, 0);
+        }
+
+        if(!world->died)
+            purchases += Autoplay();
+
+        UpdateGame(TICK_TIME);
+        RecordCheck();
+        if(world->score > bestScore)
+            bestScore = world->score;
+    }
+
+    printf("seed=%u ticks=%ld deaths=%d best_score=%d score=%d coins=%d hearts=%d purchases=%d enemies=%d dropped_spawns=%d reclaimed=%d hash=%08x\n",
+        seed, ticks, deaths, bestScore, world->score, world->coins, world->hearts, purchases, world->enemyCount, world->droppedSpawns, world->reclaimedEnemies, HashGame());
+    StopRecording();
+    CloseWorkers();
+    FreeWorld(world);
+    return 0;
+}
+#endif
\ No newline at end of file
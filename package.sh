@@ -1,10 +1,21 @@
 # This shell script automates the process of compiling and compressing the project
 
+# Every build runs the same table math and never fuses a multiply into an add, so a replay plays the same everywhere
+MATH="-DDETERMINISTIC -ffp-contract=off"
+
 # Compile natively (linux)
-g++ main.c -o block_cycle -lraylib -Werror || exit
+g++ main.c -o block_cycle $MATH -lraylib -lpthread -Werror || exit
+
+# Pack the sprites into one archive of decoded pixels, then build it into the game so it ships as one file
+./block_cycle --pack resources/sprites.pak || exit
+xxd -i resources/sprites.pak > sprites_pak.h || exit
+g++ main.c -o block_cycle -DEMBED_ASSETS $MATH -lraylib -lpthread -Werror || exit
+
+# Compile the headless simulator (no window or raylib needed, used for CI)
+g++ main.c -o block_cycle_headless -DHEADLESS $MATH -O2 -lpthread -Werror || exit
 
 # Cross-compile for windows
-x86_64-w64-mingw32-gcc main.c -o block_cycle.exe -Werror -lraylib || exit
+x86_64-w64-mingw32-gcc main.c -o block_cycle.exe -DEMBED_ASSETS $MATH -Werror -lraylib -lpthread || exit
 
 # Copy in all of the required dynamic libraries
 cp lib/win/*.dll ./